@@ -0,0 +1,76 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "atom.h"
+#include "record.h"
+
+#ifndef AETERNUM_BENCH_FIELDS
+#define AETERNUM_BENCH_FIELDS 16
+#endif
+
+namespace wide {
+    constexpr aeternum::atom tag("wide");
+
+    template<std::size_t I>
+    using field_type = std::tuple_element_t<I % 3, std::tuple<std::uint64_t, double, std::string>>;
+
+    template<std::size_t I>
+    struct field_label {
+        static constexpr char value[] = { 'f', char('0' + I / 100 % 10), char('0' + I / 10 % 10), char('0' + I % 10), '\0' };
+    };
+
+    template<std::size_t I>
+    constexpr aeternum::field_name<field_type<I>> field_(field_label<I>::value);
+
+    template<std::size_t I>
+    field_type<I> make_value(std::size_t seed) {
+        if constexpr (I % 3 == 2) {
+            return std::to_string(seed + I);
+        } else {
+            return field_type<I>(seed + I);
+        }
+    }
+
+    template<typename Indices>
+    struct schema;
+
+    template<std::size_t ...Is>
+    struct schema<std::index_sequence<Is...>> {
+        using record =
+            typename aeternum::fields<field_type<Is>...>
+                ::template record<tag, field_<Is>...>;
+
+        static typename record::tagged make(std::size_t seed) {
+            return record::make(make_value<Is>(seed)...);
+        }
+    };
+
+    using record_schema = schema<std::make_index_sequence<AETERNUM_BENCH_FIELDS>>;
+}
+
+namespace std {
+    template<>
+    struct hash<wide::record_schema::record> {
+        typedef wide::record_schema::record argument_type;
+        typedef std::size_t result_type;
+
+        result_type operator()(const argument_type& record) const noexcept
+        {
+            return record.get_hash();
+        }
+    };
+}
+
+int main()
+{
+    auto const first = wide::record_schema::make(0);
+    auto const second = wide::record_schema::make(1);
+
+    std::cout << AETERNUM_BENCH_FIELDS << " fields, hash: " << first->get_hash()
+              << ", equal: " << (*first == *second) << std::endl;
+
+    return 0;
+}
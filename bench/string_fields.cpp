@@ -0,0 +1,108 @@
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "atom.h"
+#include "immutable_string.h"
+#include "record.h"
+
+#ifndef AETERNUM_BENCH_RECORDS
+#define AETERNUM_BENCH_RECORDS 100000
+#endif
+
+template<typename TString>
+struct contact {
+    static constexpr aeternum::atom tag{ "contact" };
+
+    static constexpr aeternum::field_name<TString> name_{ "name" };
+    static constexpr aeternum::field_name<TString> email_{ "email" };
+
+    using record =
+        typename aeternum::fields<TString, TString>
+            ::template record<tag, name_, email_>;
+};
+
+struct record_hash {
+    template<typename TRecord>
+    std::size_t operator()(const TRecord& record) const noexcept
+    {
+        return record.get_hash();
+    }
+};
+
+namespace std {
+    template<>
+    struct hash<contact<std::string>::record> : record_hash {};
+
+    template<>
+    struct hash<contact<aeternum::immutable_string>::record> : record_hash {};
+}
+
+template<typename TString>
+TString make_string(const std::string& value) {
+    return TString(value);
+}
+
+template<>
+aeternum::immutable_string make_string(const std::string& value) {
+    return aeternum::immutable_string::intern(value);
+}
+
+template<typename TFunction>
+double time_ms(TFunction&& function) {
+    auto const start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<typename TString>
+void run(const char* label) {
+    using schema = contact<TString>;
+
+    std::vector<std::string> names, emails;
+    for (std::size_t i = 0; i < AETERNUM_BENCH_RECORDS; i++) {
+        names.push_back("A reasonably long display name #" + std::to_string(i % 1000));
+        emails.push_back("someone.with.a.long.address" + std::to_string(i) + "@example.com");
+    }
+
+    std::vector<typename schema::record::tagged> records, copies;
+    auto const make = time_ms([&]() {
+        for (std::size_t i = 0; i < names.size(); i++) {
+            records.push_back(schema::record::make(make_string<TString>(names[i]), TString(emails[i])));
+            copies.push_back(schema::record::make(make_string<TString>(names[i]), TString(emails[i])));
+        }
+    });
+
+    std::size_t checksum = 0;
+    auto const get = time_ms([&]() {
+        for (auto& record : records) {
+            checksum += record->get(schema::name_).size();
+        }
+    });
+
+    auto const hash = time_ms([&]() {
+        for (auto& record : records) {
+            checksum ^= record->get_hash();
+        }
+    });
+
+    auto const equal = time_ms([&]() {
+        for (std::size_t i = 0; i < records.size(); i++) {
+            checksum += *records[i] == *copies[i];
+        }
+    });
+
+    std::cout << label << ": make " << make << " ms, get " << get << " ms, hash " << hash
+              << " ms, equal " << equal << " ms (checksum " << checksum << ")" << std::endl;
+}
+
+int main()
+{
+    std::cout << AETERNUM_BENCH_RECORDS << " records" << std::endl;
+    run<std::string>("std::string");
+    run<aeternum::immutable_string>("immutable_string");
+
+    return 0;
+}
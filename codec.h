@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "immer/vector.hpp"
+#include "immer/vector_transient.hpp"
+
+#include "collection_utils.h"
+#include "immutable_string.h"
+#include "tagged.h"
+
+namespace aeternum {
+
+    class codec_reader {
+    public:
+        codec_reader(const char *first, const char *last) : _position(first), _last(last) {}
+
+        inline const char *read(std::size_t length);
+
+        bool empty() const { return _position == _last; }
+
+    private:
+        const char *_position;
+        const char *_last;
+    };
+
+    // Compact binary encoding of field values in native byte order. Records are encoded field by field
+    // in declaration order, so the schema itself is never written. Specialise codec for custom field
+    // types with static write(std::string&, const T&) and read(codec_reader&) functions.
+    template<typename T, typename = void>
+    struct codec;
+
+    template<typename T>
+    struct codec<T, std::enable_if_t<std::is_arithmetic<T>::value>> {
+        static void write(std::string &out, const T &value) {
+            out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+        }
+
+        static T read(codec_reader &in) {
+            T value;
+            std::memcpy(&value, in.read(sizeof(T)), sizeof(T));
+            return value;
+        }
+    };
+
+    template<>
+    struct codec<std::string> {
+        static void write(std::string &out, const std::string &value) {
+            codec<std::uint32_t>::write(out, static_cast<std::uint32_t>(value.size()));
+            out.append(value);
+        }
+
+        static std::string read(codec_reader &in) {
+            const auto length = codec<std::uint32_t>::read(in);
+            return std::string(in.read(length), length);
+        }
+    };
+
+    template<>
+    struct codec<immutable_string> {
+        static void write(std::string &out, const immutable_string &value) {
+            codec<std::uint32_t>::write(out, static_cast<std::uint32_t>(value.size()));
+            out.append(value.data(), value.size());
+        }
+
+        static immutable_string read(codec_reader &in) {
+            const auto length = codec<std::uint32_t>::read(in);
+            return immutable_string(std::string_view(in.read(length), length));
+        }
+    };
+
+    template<typename T>
+    struct codec<immer::vector<T>> {
+        static void write(std::string &out, const immer::vector<T> &value) {
+            codec<std::uint32_t>::write(out, static_cast<std::uint32_t>(value.size()));
+            for (auto& item : value) {
+                codec<T>::write(out, item);
+            }
+        }
+
+        static immer::vector<T> read(codec_reader &in) {
+            const auto length = codec<std::uint32_t>::read(in);
+            auto items = immer::vector<T>().transient();
+            for (std::uint32_t i = 0; i < length; i++) {
+                items.push_back(codec<T>::read(in));
+            }
+            return items.persistent();
+        }
+    };
+
+    template<typename T, typename Hash>
+    struct codec<hashed_vector<T, Hash>> {
+        static void write(std::string &out, const hashed_vector<T, Hash> &value) {
+            codec<immer::vector<T>>::write(out, value.items());
+        }
+
+        static hashed_vector<T, Hash> read(codec_reader &in) {
+            return hashed_vector<T, Hash>(codec<immer::vector<T>>::read(in));
+        }
+    };
+
+    template<typename TRecord>
+    struct codec<TRecord, std::void_t<typename TRecord::field_types>> {
+        static void write(std::string &out, const TRecord &record) {
+            record.for_each_field([&](const auto &, const auto &value) {
+                codec<std::decay_t<decltype(value)>>::write(out, value);
+            });
+        }
+
+        static TRecord read(codec_reader &in) {
+            return read_fields(in, static_cast<typename TRecord::field_types *>(nullptr));
+        }
+
+    private:
+        template<typename ...TFieldTypes>
+        static TRecord read_fields(codec_reader &in, std::tuple<TFieldTypes...> *) {
+            std::tuple<TFieldTypes...> values{ codec<TFieldTypes>::read(in)... };
+            return std::apply([](TFieldTypes &...fields) { return TRecord(std::move(fields)...); }, values);
+        }
+    };
+
+    template<typename TRecord>
+    struct codec<tagged<TRecord>, std::void_t<typename TRecord::field_types>> {
+        static void write(std::string &out, const tagged<TRecord> &value) {
+            codec<TRecord>::write(out, *value);
+        }
+
+        static tagged<TRecord> read(codec_reader &in) {
+            return read_fields(in, static_cast<typename TRecord::field_types *>(nullptr));
+        }
+
+    private:
+        template<typename ...TFieldTypes>
+        static tagged<TRecord> read_fields(codec_reader &in, std::tuple<TFieldTypes...> *) {
+            std::tuple<TFieldTypes...> values{ codec<TFieldTypes>::read(in)... };
+            return std::apply([](TFieldTypes &...fields) { return TRecord::make(std::move(fields)...); }, values);
+        }
+    };
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : CODEC READER
+// --------------------------------------------------------------------------------------------
+
+    const char *codec_reader::read(std::size_t length) {
+        if (static_cast<std::size_t>(_last - _position) < length) {
+            throw std::out_of_range("codec_reader: unexpected end of input");
+        }
+
+        auto const position = _position;
+        _position += length;
+        return position;
+    }
+}
@@ -4,7 +4,155 @@
 
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
 #include "immer/vector.hpp"
+#include "immer/vector_transient.hpp"
+
+namespace aeternum {
+
+    // An immer::vector paired with a persistent tree of block hashes, so that the hash of a new version
+    // is recomputed along a single path after an edit. Equality rejects on hash mismatch and otherwise
+    // defers to immer's comparison, which skips nodes shared between the two vectors.
+    template<typename T, typename Hash = std::hash<T>>
+    class hashed_vector {
+    public:
+        using value_type = T;
+        using size_type = std::size_t;
+        using iterator = typename immer::vector<T>::const_iterator;
+        using const_iterator = iterator;
+
+        hashed_vector();
+
+        hashed_vector(immer::vector<T> items);
+
+        hashed_vector(std::initializer_list<T> items);
+
+        const immer::vector<T>& items() const { return _items; }
+
+        size_type size() const { return _items.size(); }
+
+        bool empty() const { return _items.empty(); }
+
+        iterator begin() const { return _items.begin(); }
+
+        iterator end() const { return _items.end(); }
+
+        const T& operator[](size_type index) const { return _items[index]; }
+
+        inline hashed_vector push_back(T value) const;
+
+        inline hashed_vector set(size_type index, T value) const;
+
+        inline std::size_t get_hash() const;
+
+        bool operator==(const hashed_vector& rhs) const {
+            return size() == rhs.size()
+                   && get_hash() == rhs.get_hash()
+                   && _items == rhs._items;
+        }
+
+        bool operator!=(const hashed_vector& rhs) const { return !(*this == rhs); }
+
+    private:
+        static constexpr size_type branches = 32;
+
+        using level = immer::vector<std::size_t>;
+
+        static std::size_t combine(std::size_t seed, std::size_t hash) {
+            return seed ^ (hash + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+        }
+
+        inline std::size_t hash_block(size_type depth, size_type block) const;
+
+        inline void rehash(size_type index);
+
+        inline void grow();
+
+        immer::vector<T> _items;
+        std::vector<level> _levels;
+    };
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : HASHED VECTOR
+// --------------------------------------------------------------------------------------------
+
+    template<typename T, typename Hash>
+    hashed_vector<T, Hash>::hashed_vector() = default;
+
+    template<typename T, typename Hash>
+    hashed_vector<T, Hash>::hashed_vector(immer::vector<T> items) : _items(std::move(items)) {
+        grow();
+    }
+
+    template<typename T, typename Hash>
+    hashed_vector<T, Hash>::hashed_vector(std::initializer_list<T> items) : hashed_vector(immer::vector<T>(items)) {}
+
+    template<typename T, typename Hash>
+    hashed_vector<T, Hash> hashed_vector<T, Hash>::push_back(T value) const {
+        auto result = *this;
+        result._items = result._items.push_back(std::move(value));
+        result.rehash(result._items.size() - 1);
+        return result;
+    }
+
+    template<typename T, typename Hash>
+    hashed_vector<T, Hash> hashed_vector<T, Hash>::set(size_type index, T value) const {
+        auto result = *this;
+        result._items = result._items.set(index, std::move(value));
+        result.rehash(index);
+        return result;
+    }
+
+    template<typename T, typename Hash>
+    std::size_t hashed_vector<T, Hash>::get_hash() const {
+        std::size_t seed = _items.size();
+        return _levels.empty() ? seed : combine(seed, _levels.back()[0]);
+    }
+
+    template<typename T, typename Hash>
+    std::size_t hashed_vector<T, Hash>::hash_block(size_type depth, size_type block) const {
+        const size_type first = block * branches;
+        const size_type last = std::min(first + branches, depth == 0 ? _items.size() : _levels[depth - 1].size());
+
+        std::size_t seed = last - first;
+        for (auto i = first; i < last; i++) {
+            seed = combine(seed, depth == 0 ? Hash{}(_items[i]) : _levels[depth - 1][i]);
+        }
+
+        return seed;
+    }
+
+    template<typename T, typename Hash>
+    void hashed_vector<T, Hash>::rehash(size_type index) {
+        for (size_type depth = 0; depth < _levels.size(); depth++) {
+            index /= branches;
+            const auto hash = hash_block(depth, index);
+            _levels[depth] = index < _levels[depth].size()
+                             ? _levels[depth].set(index, hash)
+                             : _levels[depth].push_back(hash);
+        }
+
+        grow();
+    }
+
+    template<typename T, typename Hash>
+    void hashed_vector<T, Hash>::grow() {
+        while (_levels.empty() ? !_items.empty() : _levels.back().size() > 1) {
+            const size_type depth = _levels.size();
+            const size_type entries = depth == 0 ? _items.size() : _levels.back().size();
+
+            auto hashes = level().transient();
+            for (size_type block = 0; block * branches < entries; block++) {
+                hashes.push_back(hash_block(depth, block));
+            }
+            _levels.push_back(hashes.persistent());
+        }
+    }
+}
 
 namespace std {
     template<typename T>
@@ -26,23 +174,16 @@ namespace std {
             return seed;
         }
     };
-}
 
-template<typename T, class Equals = std::equal_to<T>>
-bool operator==(const immer::vector<T>& lhs, const immer::vector<T>& rhs)
-{
-    if (lhs.size() != rhs.size())
+    template<typename T, typename Hash>
+    struct hash<aeternum::hashed_vector<T, Hash>>
     {
-        return false;
-    }
+        typedef aeternum::hashed_vector<T, Hash> argument_type;
+        typedef std::size_t result_type;
 
-    for (auto i = 0; i < lhs.size(); i++)
-    {
-        if (!Equals(lhs[i], rhs[i]))
+        result_type operator()(const argument_type& vec) const noexcept
         {
-            return false;
+            return vec.get_hash();
         }
-    }
-
-    return true;
-}
\ No newline at end of file
+    };
+}
@@ -67,7 +67,7 @@ constexpr uint32_t crc_table[256] = {
 // Constexpr implementation and helpers
 constexpr uint32_t crc32_impl(const char* p, size_t len, uint32_t crc) {
     return len
-           ? crc32_impl(p + 1, len - 1, (crc >> 8) ^ crc_table[(crc & 0xFF) ^ *p])
+           ? crc32_impl(p + 1, len - 1, (crc >> 8) ^ crc_table[(crc & 0xFF) ^ static_cast<unsigned char>(*p)])
            : crc;
 }
 
@@ -78,3 +78,12 @@ constexpr uint32_t crc32(const char* data, size_t length) {
 constexpr size_t strlen_c(const char* str) {
     return *str ? 1 + strlen_c(str + 1) : 0;
 }
+
+// Iterative implementation for large buffers, where the recursion above would be too deep
+constexpr uint32_t crc32_buffer(const char* data, size_t length) {
+    uint32_t crc = ~0u;
+    for (size_t i = 0; i < length; i++) {
+        crc = (crc >> 8) ^ crc_table[(crc & 0xFF) ^ static_cast<unsigned char>(data[i])];
+    }
+    return ~crc;
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+#include "immer/algorithm.hpp"
+#include "immer/vector.hpp"
+
+#include "atom.h"
+#include "collection_utils.h"
+#include "immutable_string.h"
+#include "tagged.h"
+
+namespace aeternum {
+
+    class footprint;
+
+    // Measures the heap owned by a field value beyond the value itself. Specialise for custom field types
+    // that own memory; the default assumes there is none.
+    template<typename T, typename = void>
+    struct footprint_of {
+        static void measure(const T &, footprint &, const atom &, const atom *) {}
+    };
+
+    // Estimates the memory retained by a set of record graphs. Every allocation is identified by its address
+    // (record objects, immer map roots, field payloads and vector leaves) and counted once, however many
+    // roots reach it. Bytes reachable from more than one root are reported as shared, the rest as unique,
+    // and both are broken down by record tag and by field name. Sizes of immer nodes are estimates based
+    // on entry counts, since their layout is not public, and fields set outside a record's own schema are
+    // counted in its map but not followed.
+    class footprint {
+    public:
+        struct usage {
+            std::size_t total = 0;
+            std::size_t unique = 0;
+            std::size_t shared = 0;
+        };
+
+        static constexpr std::size_t allocation_overhead = 2 * sizeof(void *);
+
+        template<typename TRecord>
+        void add_root(const tagged<TRecord> &root);
+
+        inline usage total() const;
+
+        inline std::unordered_map<atom, usage> by_tag() const;
+
+        inline std::unordered_map<atom, usage> by_field() const;
+
+        template<typename TRecord>
+        void measure(const TRecord &record, const atom &tag);
+
+        inline bool visit(const void *identity, std::size_t bytes, const atom &tag, const atom *field);
+
+    private:
+        struct block {
+            std::size_t bytes;
+            atom tag;
+            std::optional<atom> field;
+            std::size_t roots;
+            std::size_t last_root;
+        };
+
+        static inline void add(usage &usage, const block &block);
+
+        std::unordered_map<const void *, block> _blocks;
+        std::size_t _roots = 0;
+    };
+
+    template<>
+    struct footprint_of<std::string> {
+        static void measure(const std::string &value, footprint &accountant, const atom &tag, const atom *field) {
+            auto const inline_buffer = reinterpret_cast<const char *>(&value);
+            if (value.data() < inline_buffer || value.data() >= inline_buffer + sizeof(std::string)) {
+                accountant.visit(value.data(), value.capacity() + 1, tag, field);
+            }
+        }
+    };
+
+    template<>
+    struct footprint_of<immutable_string> {
+        static void measure(const immutable_string &value, footprint &accountant, const atom &tag, const atom *field) {
+            if (!value.empty()) {
+                accountant.visit(value.data(), value.size() + 1 + 4 * sizeof(std::size_t), tag, field);
+            }
+        }
+    };
+
+    template<typename T>
+    struct footprint_of<immer::vector<T>> {
+        static void measure(const immer::vector<T> &value, footprint &accountant, const atom &tag, const atom *field) {
+            immer::for_each_chunk(value, [&](const T *first, const T *last) {
+                if (accountant.visit(first, (last - first) * sizeof(T) + footprint::allocation_overhead + sizeof(void *), tag, field)) {
+                    for (auto item = first; item != last; ++item) {
+                        footprint_of<T>::measure(*item, accountant, tag, field);
+                    }
+                }
+            });
+        }
+    };
+
+    template<typename T, typename Hash>
+    struct footprint_of<hashed_vector<T, Hash>> {
+        static void measure(const hashed_vector<T, Hash> &value, footprint &accountant, const atom &tag, const atom *field) {
+            footprint_of<immer::vector<T>>::measure(value.items(), accountant, tag, field);
+        }
+    };
+
+    template<typename TRecord>
+    struct footprint_of<tagged<TRecord>, std::void_t<typename TRecord::field_types>> {
+        static void measure(const tagged<TRecord> &value, footprint &accountant, const atom &, const atom *) {
+            if (value) {
+                accountant.measure(*value, value.get_tag());
+            }
+        }
+    };
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : FOOTPRINT
+// --------------------------------------------------------------------------------------------
+
+    template<typename TRecord>
+    void footprint::add_root(const tagged<TRecord> &root) {
+        _roots++;
+        if (root) {
+            measure(*root, root.get_tag());
+        }
+    }
+
+    template<typename TRecord>
+    void footprint::measure(const TRecord &record, const atom &tag) {
+        if (!visit(&record, sizeof(TRecord) + allocation_overhead, tag, nullptr)) {
+            return;
+        }
+
+        auto const& data = record.raw_data();
+        if (!visit(data.identity(), data.size() * sizeof(typename TRecord::data::value_type) + allocation_overhead, tag, nullptr)) {
+            return;
+        }
+
+        record.for_each_field([&](const auto &name, const auto &value) {
+            using field_type = std::decay_t<decltype(value)>;
+
+            auto const field = name.key();
+            if (visit(&value, sizeof(field_type) + allocation_overhead, tag, &field)) {
+                footprint_of<field_type>::measure(value, *this, tag, &field);
+            }
+        });
+    }
+
+    bool footprint::visit(const void *identity, std::size_t bytes, const atom &tag, const atom *field) {
+        auto const found = _blocks.find(identity);
+        if (found == _blocks.end()) {
+            _blocks.emplace(identity, block{ bytes, tag, field ? std::optional<atom>(*field) : std::nullopt, 1, _roots });
+            return true;
+        }
+
+        auto& existing = found->second;
+        if (existing.last_root == _roots) {
+            return false;
+        }
+
+        existing.last_root = _roots;
+        if (existing.roots > 1) {
+            return false;
+        }
+
+        existing.roots = 2;
+        return true;
+    }
+
+    footprint::usage footprint::total() const {
+        usage result;
+        for (auto& entry : _blocks) {
+            add(result, entry.second);
+        }
+        return result;
+    }
+
+    std::unordered_map<atom, footprint::usage> footprint::by_tag() const {
+        std::unordered_map<atom, usage> result;
+        for (auto& entry : _blocks) {
+            add(result[entry.second.tag], entry.second);
+        }
+        return result;
+    }
+
+    std::unordered_map<atom, footprint::usage> footprint::by_field() const {
+        std::unordered_map<atom, usage> result;
+        for (auto& entry : _blocks) {
+            if (entry.second.field) {
+                add(result[*entry.second.field], entry.second);
+            }
+        }
+        return result;
+    }
+
+    void footprint::add(usage &usage, const block &block) {
+        usage.total += block.bytes;
+        if (block.roots > 1) {
+            usage.shared += block.bytes;
+        } else {
+            usage.unique += block.bytes;
+        }
+    }
+}
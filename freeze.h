@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "immer/map.hpp"
+#include "immer/map_transient.hpp"
+#include "immer/vector.hpp"
+#include "immer/vector_transient.hpp"
+
+#include "record.h"
+#include "tagged.h"
+
+namespace aeternum {
+
+    // A bump allocator that destroys what it constructed, in reverse order, when it is itself destroyed.
+    // Memory handed out through allocate is only returned with the arena.
+    class frozen_arena {
+    public:
+        explicit frozen_arena(std::size_t capacity) : _capacity(0), _offset(0) { grow(capacity); }
+
+        frozen_arena(const frozen_arena &other) = delete;
+        frozen_arena &operator=(const frozen_arena &other) = delete;
+
+        inline ~frozen_arena();
+
+        template<typename T, typename ...TArgs>
+        T *construct(TArgs &&...args);
+
+        inline void *allocate(std::size_t size, std::size_t alignment);
+
+    private:
+        inline void grow(std::size_t capacity);
+
+        std::vector<std::unique_ptr<unsigned char[]>> _blocks;
+        std::size_t _capacity;
+        std::size_t _offset;
+        std::vector<std::pair<void *, void (*)(void *)>> _destructors;
+    };
+
+    // Allocates from an arena and keeps it alive, so that objects made with std::allocate_shared hold the
+    // arena for as long as they live.
+    template<typename T>
+    class arena_allocator {
+    public:
+        using value_type = T;
+
+        explicit arena_allocator(std::shared_ptr<frozen_arena> arena) : _arena(std::move(arena)) {}
+
+        template<typename U>
+        arena_allocator(const arena_allocator<U> &other) : _arena(other._arena) {}
+
+        T *allocate(std::size_t count) { return static_cast<T *>(_arena->allocate(count * sizeof(T), alignof(T))); }
+
+        void deallocate(T *, std::size_t) {}
+
+        template<typename U>
+        bool operator==(const arena_allocator<U> &other) const { return _arena == other._arena; }
+
+        template<typename U>
+        bool operator!=(const arena_allocator<U> &other) const { return _arena != other._arena; }
+
+    private:
+        template<typename>
+        friend class arena_allocator;
+
+        std::shared_ptr<frozen_arena> _arena;
+    };
+
+    class freezer;
+
+    // Copies a field value into the arena. The default copy-constructs the value, so memory it owns
+    // elsewhere (such as a long std::string's buffer or immer vector nodes) stays where it is.
+    template<typename T, typename = void>
+    struct freeze_field {
+        static inline std::size_t measure(const T &value, freezer &freezer);
+
+        static inline std::shared_ptr<T> copy(const T &value, freezer &freezer);
+    };
+
+    template<typename TRecord>
+    struct freeze_field<tagged<TRecord>, std::void_t<typename TRecord::field_types>> {
+        static inline std::size_t measure(const tagged<TRecord> &value, freezer &freezer);
+
+        static inline std::shared_ptr<tagged<TRecord>> copy(const tagged<TRecord> &value, freezer &freezer);
+    };
+
+    // Re-lays record graphs into a single arena in traversal order, keeping shared records and field
+    // values shared. Field values share the arena's reference count and are destroyed with it. Records and
+    // nested record handles link to other values in the arena, so each keeps its own reference count
+    // beside it in the arena instead; were they destroyed with the arena, it would hold references to
+    // itself and never be freed. Anything read out of a frozen graph keeps the arena alive.
+    //
+    // Field maps are immer maps with the default memory policy: their nodes are rebuilt in traversal order
+    // but allocated outside the arena, as is memory owned by field values themselves.
+    class freezer {
+    public:
+        template<typename TRecord>
+        void measure(const TRecord &record);
+
+        inline void reserve();
+
+        template<typename TRecord>
+        tagged<TRecord> freeze(const tagged<TRecord> &value);
+
+        // Constructs a value that holds no links into the arena; it shares the arena's reference count.
+        template<typename T, typename ...TArgs>
+        std::shared_ptr<T> make_value(TArgs &&...args);
+
+        // Constructs a value that links to others in the arena, with its own reference count.
+        template<typename T, typename ...TArgs>
+        std::shared_ptr<T> make_linked(TArgs &&...args);
+
+        // The space make_linked takes for a T, including the control block allocated with it.
+        template<typename T>
+        static constexpr std::size_t linked_size = sizeof(T) + alignof(T) + 4 * sizeof(void *) + sizeof(arena_allocator<T>);
+
+    private:
+        template<typename T>
+        std::shared_ptr<void> freeze_value(const T &value);
+
+        std::unordered_set<const void *> _measured;
+        std::unordered_map<const void *, std::shared_ptr<void>> _frozen;
+        std::size_t _bytes = 0;
+        std::shared_ptr<frozen_arena> _arena;
+    };
+
+    template<typename TRecord>
+    tagged<TRecord> freeze(const tagged<TRecord> &root);
+
+    template<typename TRecord>
+    immer::vector<tagged<TRecord>> freeze(const immer::vector<tagged<TRecord>> &roots);
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : FROZEN ARENA
+// --------------------------------------------------------------------------------------------
+
+    frozen_arena::~frozen_arena() {
+        for (auto it = _destructors.rbegin(); it != _destructors.rend(); ++it) {
+            it->second(it->first);
+        }
+    }
+
+    template<typename T, typename ...TArgs>
+    T *frozen_arena::construct(TArgs &&...args) {
+        auto const result = new (allocate(sizeof(T), alignof(T))) T(std::forward<TArgs>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            _destructors.emplace_back(result, [](void *value) { static_cast<T *>(value)->~T(); });
+        }
+        return result;
+    }
+
+    void *frozen_arena::allocate(std::size_t size, std::size_t alignment) {
+        auto offset = (_offset + alignment - 1) / alignment * alignment;
+        if (offset + size > _capacity) {
+            grow(std::max(size + alignment, _capacity));
+            offset = 0;
+        }
+
+        _offset = offset + size;
+        return _blocks.back().get() + offset;
+    }
+
+    void frozen_arena::grow(std::size_t capacity) {
+        _blocks.emplace_back(new unsigned char[std::max<std::size_t>(capacity, 1)]);
+        _capacity = capacity;
+        _offset = 0;
+    }
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : FREEZER
+// --------------------------------------------------------------------------------------------
+
+    template<typename T, typename TEnable>
+    std::size_t freeze_field<T, TEnable>::measure(const T &, freezer &) {
+        return sizeof(T) + alignof(T);
+    }
+
+    template<typename T, typename TEnable>
+    std::shared_ptr<T> freeze_field<T, TEnable>::copy(const T &value, freezer &freezer) {
+        return freezer.make_value<T>(value);
+    }
+
+    template<typename TRecord>
+    std::size_t freeze_field<tagged<TRecord>, std::void_t<typename TRecord::field_types>>::measure(
+            const tagged<TRecord> &value, freezer &freezer) {
+        if (value) {
+            freezer.measure(*value);
+        }
+        return freezer::linked_size<tagged<TRecord>>;
+    }
+
+    template<typename TRecord>
+    std::shared_ptr<tagged<TRecord>> freeze_field<tagged<TRecord>, std::void_t<typename TRecord::field_types>>::copy(
+            const tagged<TRecord> &value, freezer &freezer) {
+        return freezer.make_linked<tagged<TRecord>>(value ? freezer.freeze(value) : value);
+    }
+
+    template<typename TRecord>
+    void freezer::measure(const TRecord &record) {
+        if (!_measured.insert(&record).second) {
+            return;
+        }
+
+        _bytes += linked_size<TRecord>;
+        record.for_each_field([&](const auto &, const auto &value) {
+            if (_measured.insert(&value).second) {
+                _bytes += freeze_field<std::decay_t<decltype(value)>>::measure(value, *this);
+            }
+        });
+    }
+
+    void freezer::reserve() {
+        _arena = std::make_shared<frozen_arena>(_bytes);
+    }
+
+    template<typename TRecord>
+    tagged<TRecord> freezer::freeze(const tagged<TRecord> &value) {
+        auto const& source = *value;
+
+        auto found = _frozen.find(&source);
+        if (found == _frozen.end()) {
+            auto fields = untyped_record::data().transient();
+            for (auto& field : source.raw_data()) {
+                fields.set(field.first, field.second);
+            }
+            source.for_each_field([&](const auto &name, const auto &field) {
+                fields.set(name.key(), freeze_value(field));
+            });
+
+            found = _frozen.emplace(&source, make_linked<TRecord>(source.with_raw_data(fields.persistent()))).first;
+        }
+
+        return tagged<TRecord>(value.get_tag(), std::static_pointer_cast<TRecord>(found->second));
+    }
+
+    template<typename T, typename ...TArgs>
+    std::shared_ptr<T> freezer::make_value(TArgs &&...args) {
+        return std::shared_ptr<T>(_arena, _arena->construct<T>(std::forward<TArgs>(args)...));
+    }
+
+    template<typename T, typename ...TArgs>
+    std::shared_ptr<T> freezer::make_linked(TArgs &&...args) {
+        return std::allocate_shared<T>(arena_allocator<T>(_arena), std::forward<TArgs>(args)...);
+    }
+
+    template<typename T>
+    std::shared_ptr<void> freezer::freeze_value(const T &value) {
+        auto found = _frozen.find(&value);
+        if (found == _frozen.end()) {
+            found = _frozen.emplace(&value, freeze_field<T>::copy(value, *this)).first;
+        }
+        return found->second;
+    }
+
+    template<typename TRecord>
+    tagged<TRecord> freeze(const tagged<TRecord> &root) {
+        if (!root) {
+            return root;
+        }
+
+        freezer freezer;
+        freezer.measure(*root);
+        freezer.reserve();
+        return freezer.freeze(root);
+    }
+
+    template<typename TRecord>
+    immer::vector<tagged<TRecord>> freeze(const immer::vector<tagged<TRecord>> &roots) {
+        freezer freezer;
+        for (auto& root : roots) {
+            if (root) {
+                freezer.measure(*root);
+            }
+        }
+        freezer.reserve();
+
+        auto result = immer::vector<tagged<TRecord>>().transient();
+        for (auto& root : roots) {
+            result.push_back(root ? freezer.freeze(root) : root);
+        }
+        return result.persistent();
+    }
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace aeternum {
+
+    // An immutable string for record fields. The characters, a reference count and the hash live in one
+    // allocation, so copies only bump the count and hashing is a load. intern() returns a canonical copy
+    // that is never freed and is copied without touching the count; two interned strings are equal exactly
+    // when they share storage. Intern bounded vocabularies such as names and tags, not arbitrary input.
+    class immutable_string {
+    public:
+        immutable_string() noexcept : _buffer(nullptr) {}
+
+        immutable_string(const char *value) : immutable_string(std::string_view(value)) {}
+
+        immutable_string(const std::string &value) : immutable_string(std::string_view(value)) {}
+
+        explicit immutable_string(std::string_view value) : _buffer(allocate(value, false)) {}
+
+        immutable_string(const immutable_string &other) noexcept : _buffer(other._buffer) { retain(); }
+
+        immutable_string(immutable_string &&other) noexcept : _buffer(other._buffer) { other._buffer = nullptr; }
+
+        ~immutable_string() { release(); }
+
+        inline immutable_string &operator=(const immutable_string &other) noexcept;
+
+        inline immutable_string &operator=(immutable_string &&other) noexcept;
+
+        static inline immutable_string intern(std::string_view value);
+
+        const char *data() const { return _buffer ? characters(_buffer) : ""; }
+
+        const char *c_str() const { return data(); }
+
+        std::size_t size() const { return _buffer ? _buffer->size : 0; }
+
+        bool empty() const { return size() == 0; }
+
+        bool is_interned() const { return _buffer && _buffer->interned; }
+
+        std::size_t get_hash() const { return _buffer ? _buffer->hash : empty_hash(); }
+
+        std::string_view view() const { return std::string_view(data(), size()); }
+
+        operator std::string_view() const { return view(); }
+
+        std::string str() const { return std::string(data(), size()); }
+
+        inline bool operator==(const immutable_string &rhs) const;
+
+        bool operator!=(const immutable_string &rhs) const { return !(*this == rhs); }
+
+        bool operator<(const immutable_string &rhs) const { return view() < rhs.view(); }
+
+    private:
+        struct buffer {
+            std::atomic<std::size_t> references;
+            std::size_t hash;
+            std::size_t size;
+            bool interned;
+        };
+
+        explicit immutable_string(buffer *buffer) noexcept : _buffer(buffer) {}
+
+        static char *characters(buffer *buffer) { return reinterpret_cast<char *>(buffer + 1); }
+
+        static std::size_t empty_hash() { return std::hash<std::string_view>{}(std::string_view()); }
+
+        static inline buffer *allocate(std::string_view value, bool interned);
+
+        inline void retain() const noexcept;
+
+        inline void release() noexcept;
+
+        buffer *_buffer;
+    };
+
+    inline std::ostream &operator<<(std::ostream &os, const immutable_string &value) {
+        return os << value.view();
+    }
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : IMMUTABLE STRING
+// --------------------------------------------------------------------------------------------
+
+    immutable_string &immutable_string::operator=(const immutable_string &other) noexcept {
+        auto const buffer = other._buffer;
+        other.retain();
+        release();
+        _buffer = buffer;
+        return *this;
+    }
+
+    immutable_string &immutable_string::operator=(immutable_string &&other) noexcept {
+        if (this != &other) {
+            release();
+            _buffer = other._buffer;
+            other._buffer = nullptr;
+        }
+        return *this;
+    }
+
+    immutable_string immutable_string::intern(std::string_view value) {
+        static auto &mutex = *new std::mutex();
+        static auto &table = *new std::unordered_map<std::string_view, buffer *>();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto const found = table.find(value);
+        if (found != table.end()) {
+            return immutable_string(found->second);
+        }
+
+        auto const interned = allocate(value, true);
+        table.emplace(std::string_view(characters(interned), interned->size), interned);
+        return immutable_string(interned);
+    }
+
+    bool immutable_string::operator==(const immutable_string &rhs) const {
+        if (_buffer == rhs._buffer) {
+            return true;
+        }
+        if (is_interned() && rhs.is_interned()) {
+            return false;
+        }
+
+        return get_hash() == rhs.get_hash()
+               && size() == rhs.size()
+               && std::memcmp(data(), rhs.data(), size()) == 0;
+    }
+
+    immutable_string::buffer *immutable_string::allocate(std::string_view value, bool interned) {
+        if (value.empty() && !interned) {
+            return nullptr;
+        }
+
+        auto const memory = ::operator new(sizeof(buffer) + value.size() + 1);
+        auto const result = new (memory) buffer{ { 1 }, std::hash<std::string_view>{}(value), value.size(), interned };
+        std::memcpy(characters(result), value.data(), value.size());
+        characters(result)[value.size()] = '\0';
+        return result;
+    }
+
+    void immutable_string::retain() const noexcept {
+        if (_buffer && !_buffer->interned) {
+            _buffer->references.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void immutable_string::release() noexcept {
+        if (_buffer && !_buffer->interned
+            && _buffer->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            _buffer->~buffer();
+            ::operator delete(_buffer);
+        }
+        _buffer = nullptr;
+    }
+}
+
+namespace std {
+    template<>
+    struct hash<aeternum::immutable_string>
+    {
+        typedef aeternum::immutable_string argument_type;
+        typedef std::size_t result_type;
+
+        result_type operator()(const argument_type& value) const noexcept
+        {
+            return value.get_hash();
+        }
+    };
+}
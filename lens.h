@@ -5,27 +5,73 @@
 #pragma once
 
 #include <functional>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "atom.h"
 
 namespace aeternum {
+    class tagged_untyped;
+
+    template<typename T>
+    class tagged;
+
+    class untyped_record;
+
     template<typename TRecord>
     class setter {
     public:
         explicit setter(std::function<TRecord(const TRecord &)> set);
 
+        setter(std::function<TRecord(const TRecord &)> set, std::function<TRecord(TRecord &&)> update);
+
         inline TRecord apply(const TRecord &record) const;
 
+        inline TRecord apply(TRecord &&record) const;
+
     private:
         const std::function<TRecord(const TRecord &)> _set;
+        const std::function<TRecord(TRecord &&)> _update;
     };
 
+    // Maps a pointer to the value of a field along a lens path to the untyped_record the next field of the
+    // path is read from, or to null when the value holds no record.
+    using lens_step = const void *(*)(const void *value);
+
+    // The functions behind a lens, called with the lens's context. update receives records the caller will
+    // not read again and may reuse their storage when it is not shared; lenses without one copy. Lenses
+    // with a path read a field, and must accept a null value from set, which clears it. steps
+    // returns one lens_step per field of the path but the last, and may be null for single-field lenses.
+    // share returns the owner of a context held on the heap, and is null for contexts with static storage.
     template<typename TRecord, typename TField>
-    class lens {
+    struct lens_accessors {
+        std::shared_ptr<const TField> (*get)(const void *context, const TRecord &record);
+        TRecord (*set)(const void *context, const TRecord &record, const std::shared_ptr<const TField> &value);
+        TRecord (*update)(const void *context, TRecord &&record, const std::shared_ptr<const TField> &value);
+        std::vector<atom> (*path)(const void *context);
+        std::vector<lens_step> (*steps)(const void *context);
+        std::shared_ptr<const void> (*share)(const void *context);
+    };
+
+    template<typename TRecord, typename TField>
+    class lens;
+
+    // A pointer to the state a lens reads, such as a field name, and a pointer to its accessors, so it can
+    // be constant-initialised and costs nothing to copy. It does not keep the state alive; copy it into a
+    // lens to do that.
+    template<typename TRecord, typename TField>
+    class lens_ref {
     public:
         using result_type = TField;
+        using accessors = lens_accessors<TRecord, TField>;
 
-        lens(
-                std::function<std::shared_ptr<const TField>(const TRecord &)> get,
-                std::function<TRecord(const TRecord &, const std::shared_ptr<const TField> &)> set);
+        constexpr lens_ref(const void *context, const accessors &accessors) noexcept
+                : _context(context), _accessors(std::addressof(accessors)) {}
+
+        inline std::vector<atom> path() const;
+
+        inline std::vector<lens_step> steps() const;
 
         inline std::shared_ptr<const TField> get(const TRecord &record) const;
 
@@ -33,57 +79,313 @@ namespace aeternum {
 
         inline TRecord set(const TRecord &record, TField &&value) const;
 
+        inline TRecord set(TRecord &&record, const std::shared_ptr<const TField> &value) const;
+
+        inline TRecord set(TRecord &&record, TField &&value) const;
+
         inline const setter<TRecord> set(const std::shared_ptr<const TField> &value) const;
 
         inline const setter<TRecord> set(TField &&value) const;
 
     private:
-        const std::function<std::shared_ptr<const TField>(const TRecord &)> _get;
-        const std::function<TRecord(const TRecord &, std::shared_ptr<const TField>)> _set;
+        friend class lens<TRecord, TField>;
+
+        inline std::shared_ptr<const void> share() const;
+
+        const void *_context;
+        const accessors *_accessors;
+    };
+
+    // A lens that keeps its state alive, for lenses written by hand and compositions. Copies share the state.
+    template<typename TRecord, typename TField>
+    class lens : public lens_ref<TRecord, TField> {
+    public:
+        using accessors = typename lens_ref<TRecord, TField>::accessors;
+
+        lens(
+                std::function<std::shared_ptr<const TField>(const TRecord &)> get,
+                std::function<TRecord(const TRecord &, const std::shared_ptr<const TField> &)> set,
+                std::vector<atom> path = {});
+
+        lens(
+                std::function<std::shared_ptr<const TField>(const TRecord &)> get,
+                std::function<TRecord(const TRecord &, const std::shared_ptr<const TField> &)> set,
+                std::function<TRecord(TRecord &&, const std::shared_ptr<const TField> &)> update,
+                std::vector<atom> path);
+
+        // The accessors' share must return the state when given its address.
+        lens(std::shared_ptr<const void> state, const accessors &accessors)
+                : lens_ref<TRecord, TField>(state.get(), accessors), _state(std::move(state)) {}
+
+        lens(const lens_ref<TRecord, TField> &other) : lens_ref<TRecord, TField>(other), _state(other.share()) {}
+
+    private:
+        struct functions : public std::enable_shared_from_this<functions> {
+            functions(std::function<std::shared_ptr<const TField>(const TRecord &)> get,
+                      std::function<TRecord(const TRecord &, const std::shared_ptr<const TField> &)> set,
+                      std::function<TRecord(TRecord &&, const std::shared_ptr<const TField> &)> update,
+                      std::vector<atom> path)
+                    : get(std::move(get)), set(std::move(set)), update(std::move(update)), path(std::move(path)) {}
+
+            std::function<std::shared_ptr<const TField>(const TRecord &)> get;
+            std::function<TRecord(const TRecord &, const std::shared_ptr<const TField> &)> set;
+            std::function<TRecord(TRecord &&, const std::shared_ptr<const TField> &)> update;
+            std::vector<atom> path;
+
+            static inline std::shared_ptr<const TField> get_value(const void *context, const TRecord &record);
+
+            static inline TRecord set_value(const void *context, const TRecord &record, const std::shared_ptr<const TField> &value);
+
+            static inline TRecord update_value(const void *context, TRecord &&record, const std::shared_ptr<const TField> &value);
+
+            static inline std::vector<atom> value_path(const void *context);
+
+            static inline std::shared_ptr<const void> share(const void *context);
+
+            static constexpr accessors function_accessors = {
+                    &get_value, &set_value, &update_value, &value_path, nullptr, &share };
+        };
+
+        std::shared_ptr<const void> _state;
     };
 
+    inline std::vector<atom> join_paths(const std::vector<atom> &left, const std::vector<atom> &right) {
+        if (left.empty() || right.empty()) {
+            return {};
+        }
+
+        std::vector<atom> path(left);
+        path.insert(path.end(), right.begin(), right.end());
+        return path;
+    }
+
+    // The lens_step from a value of type TB to the record a lens over TInner reads, for nested records read
+    // through their type-erased base.
+    template<typename TB, typename TInner, typename = void>
+    struct nested_record {
+        static constexpr lens_step step = nullptr;
+    };
+
+    template<typename TRecord>
+    struct nested_record<tagged<TRecord>, tagged<untyped_record>,
+                         std::enable_if_t<std::is_base_of<untyped_record, TRecord>::value>> {
+        static const void *read(const void *value) {
+            auto const& record = *static_cast<const tagged<TRecord> *>(value);
+            return record ? static_cast<const untyped_record *>(&*record) : nullptr;
+        }
+
+        static constexpr lens_step step = &read;
+    };
+
+    // Focuses a lens on a field of the value another lens focuses on, where TB converts to TInner and back.
+    // The composed lens owns copies of both lenses, so composing touches no shared state. Updating a
+    // record that is not shared clears the inner value out of it first when the left lens reads a field,
+    // so that the inner value too is updated in place if the record held the only reference to it.
+    template<typename TA, typename TB, typename TInner, typename TC>
+    class lens_composition : public std::enable_shared_from_this<lens_composition<TA, TB, TInner, TC>> {
+    public:
+        static inline lens<TA, TC> compose(const lens_ref<TA, TB> &left, const lens_ref<TInner, TC> &right);
+
+    private:
+        lens_composition(const lens_ref<TA, TB> &left, const lens_ref<TInner, TC> &right)
+                : _left(left), _right(right), _clears_inner(!_left.path().empty()) {}
+
+        static inline std::shared_ptr<const TC> get(const void *context, const TA &record);
+
+        static inline TA set(const void *context, const TA &record, const std::shared_ptr<const TC> &value);
+
+        static inline TA update(const void *context, TA &&record, const std::shared_ptr<const TC> &value);
+
+        static inline std::vector<atom> path(const void *context);
+
+        static inline std::vector<lens_step> steps(const void *context);
+
+        static inline std::shared_ptr<const void> share(const void *context);
+
+        static constexpr lens_accessors<TA, TC> composed_accessors = { &get, &set, &update, &path, &steps, &share };
+
+        const lens<TA, TB> _left;
+        const lens<TInner, TC> _right;
+        const bool _clears_inner;
+    };
 
     template<typename TRecord>
     setter<TRecord>::setter(std::function<TRecord(const TRecord &)> set) : _set(std::move(set)) {}
 
+    template<typename TRecord>
+    setter<TRecord>::setter(std::function<TRecord(const TRecord &)> set, std::function<TRecord(TRecord &&)> update)
+            : _set(std::move(set)), _update(std::move(update)) {}
+
     template<typename TRecord>
     TRecord setter<TRecord>::apply(const TRecord &record) const { return _set(record); }
 
+    template<typename TRecord>
+    TRecord setter<TRecord>::apply(TRecord &&record) const {
+        return _update ? _update(std::move(record)) : _set(record);
+    }
+
+    template<typename TRecord, typename TField>
+    std::vector<atom> lens_ref<TRecord, TField>::path() const { return _accessors->path(_context); }
+
+    template<typename TRecord, typename TField>
+    std::vector<lens_step> lens_ref<TRecord, TField>::steps() const {
+        return _accessors->steps ? _accessors->steps(_context) : std::vector<lens_step>();
+    }
+
+    template<typename TRecord, typename TField>
+    std::shared_ptr<const TField> lens_ref<TRecord, TField>::get(const TRecord &record) const {
+        return _accessors->get(_context, record);
+    }
+
+    template<typename TRecord, typename TField>
+    TRecord lens_ref<TRecord, TField>::set(const TRecord &record, const std::shared_ptr<const TField> &value) const {
+        return _accessors->set(_context, record, value);
+    }
+
+    template<typename TRecord, typename TField>
+    TRecord lens_ref<TRecord, TField>::set(const TRecord &record, TField &&value) const {
+        return set(record, std::make_shared<TField>(std::forward<TField>(value)));
+    }
+
+    template<typename TRecord, typename TField>
+    TRecord lens_ref<TRecord, TField>::set(TRecord &&record, const std::shared_ptr<const TField> &value) const {
+        return _accessors->update
+               ? _accessors->update(_context, std::move(record), value)
+               : _accessors->set(_context, record, value);
+    }
+
+    template<typename TRecord, typename TField>
+    TRecord lens_ref<TRecord, TField>::set(TRecord &&record, TField &&value) const {
+        return set(std::move(record), std::make_shared<TField>(std::forward<TField>(value)));
+    }
+
+    template<typename TRecord, typename TField>
+    const setter<TRecord> lens_ref<TRecord, TField>::set(const std::shared_ptr<const TField> &value) const {
+        return setter<TRecord>(
+                [&](const TRecord &record) { return set(record, value); },
+                [&](TRecord &&record) { return set(std::move(record), value); });
+    }
+
+    template<typename TRecord, typename TField>
+    const setter<TRecord> lens_ref<TRecord, TField>::set(TField &&value) const {
+        return setter<TRecord>(
+                [&](const TRecord &record) { return set(record, std::forward<TField>(value)); },
+                [&](TRecord &&record) { return set(std::move(record), std::forward<TField>(value)); });
+    }
+
+    template<typename TRecord, typename TField>
+    std::shared_ptr<const void> lens_ref<TRecord, TField>::share() const {
+        return _accessors->share ? _accessors->share(_context) : nullptr;
+    }
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : LENS
+// --------------------------------------------------------------------------------------------
+
     template<typename TRecord, typename TField>
     lens<TRecord, TField>::lens(
             std::function<std::shared_ptr<const TField>(const TRecord &)> get,
-            std::function<TRecord(const TRecord &, const std::shared_ptr<const TField> &)> set)
-            : _get(std::move(get)), _set(std::move(set)) {}
+            std::function<TRecord(const TRecord &, const std::shared_ptr<const TField> &)> set,
+            std::vector<atom> path)
+            : lens(std::move(get), std::move(set), nullptr, std::move(path)) {}
 
     template<typename TRecord, typename TField>
-    std::shared_ptr<const TField> lens<TRecord, TField>::get(const TRecord &record) const { return _get(record); }
+    lens<TRecord, TField>::lens(
+            std::function<std::shared_ptr<const TField>(const TRecord &)> get,
+            std::function<TRecord(const TRecord &, const std::shared_ptr<const TField> &)> set,
+            std::function<TRecord(TRecord &&, const std::shared_ptr<const TField> &)> update,
+            std::vector<atom> path)
+            : lens(std::make_shared<const functions>(std::move(get), std::move(set), std::move(update), std::move(path)),
+                   functions::function_accessors) {}
 
     template<typename TRecord, typename TField>
-    TRecord lens<TRecord, TField>::set(const TRecord &record, const std::shared_ptr<const TField> &value) const {
-        return _set(record, value);
+    std::shared_ptr<const TField> lens<TRecord, TField>::functions::get_value(const void *context, const TRecord &record) {
+        return static_cast<const functions *>(context)->get(record);
     }
 
     template<typename TRecord, typename TField>
-    TRecord lens<TRecord, TField>::set(const TRecord &record, TField &&value) const {
-        return _set(record, std::make_shared<TField>(std::forward<TField>(value)));
+    TRecord lens<TRecord, TField>::functions::set_value(const void *context, const TRecord &record,
+                                                        const std::shared_ptr<const TField> &value) {
+        return static_cast<const functions *>(context)->set(record, value);
     }
 
     template<typename TRecord, typename TField>
-    const setter<TRecord> lens<TRecord, TField>::set(const std::shared_ptr<const TField> &value) const {
-        return setter<TRecord>([&](const TRecord &record) { return set(record, value); });
+    TRecord lens<TRecord, TField>::functions::update_value(const void *context, TRecord &&record,
+                                                           const std::shared_ptr<const TField> &value) {
+        auto const& state = *static_cast<const functions *>(context);
+        return state.update ? state.update(std::move(record), value) : state.set(record, value);
     }
 
     template<typename TRecord, typename TField>
-    const setter<TRecord> lens<TRecord, TField>::set(TField &&value) const {
-        return setter<TRecord>([&](const TRecord &record) { return set(record, std::forward<TField>(value)); });
+    std::vector<atom> lens<TRecord, TField>::functions::value_path(const void *context) {
+        return static_cast<const functions *>(context)->path;
+    }
+
+    template<typename TRecord, typename TField>
+    std::shared_ptr<const void> lens<TRecord, TField>::functions::share(const void *context) {
+        return static_cast<const functions *>(context)->shared_from_this();
+    }
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : LENS COMPOSITION
+// --------------------------------------------------------------------------------------------
+
+    template<typename TA, typename TB, typename TInner, typename TC>
+    lens<TA, TC> lens_composition<TA, TB, TInner, TC>::compose(const lens_ref<TA, TB> &left, const lens_ref<TInner, TC> &right) {
+        return lens<TA, TC>(std::shared_ptr<const lens_composition>(new lens_composition(left, right)), composed_accessors);
+    }
+
+    template<typename TA, typename TB, typename TInner, typename TC>
+    std::shared_ptr<const TC> lens_composition<TA, TB, TInner, TC>::get(const void *context, const TA &record) {
+        auto const& composition = *static_cast<const lens_composition *>(context);
+        return composition._right.get(*composition._left.get(record));
+    }
+
+    template<typename TA, typename TB, typename TInner, typename TC>
+    TA lens_composition<TA, TB, TInner, TC>::set(const void *context, const TA &record, const std::shared_ptr<const TC> &value) {
+        auto const& composition = *static_cast<const lens_composition *>(context);
+        return composition._left.set(record, TB(composition._right.set(*composition._left.get(record), value)));
+    }
+
+    template<typename TA, typename TB, typename TInner, typename TC>
+    TA lens_composition<TA, TB, TInner, TC>::update(const void *context, TA &&record, const std::shared_ptr<const TC> &value) {
+        auto const& composition = *static_cast<const lens_composition *>(context);
+        if constexpr (std::is_base_of<tagged_untyped, TA>::value) {
+            if (composition._clears_inner && record.unique()) {
+                TInner inner(TB(*composition._left.get(record)));
+                record = composition._left.set(std::move(record), std::shared_ptr<const TB>());
+                TB updated(composition._right.set(std::move(inner), value));
+                return composition._left.set(std::move(record), std::move(updated));
+            }
+        }
+
+        TB inner(composition._right.set(*composition._left.get(record), value));
+        return composition._left.set(std::move(record), std::move(inner));
+    }
+
+    template<typename TA, typename TB, typename TInner, typename TC>
+    std::vector<atom> lens_composition<TA, TB, TInner, TC>::path(const void *context) {
+        auto const& composition = *static_cast<const lens_composition *>(context);
+        return join_paths(composition._left.path(), composition._right.path());
+    }
+
+    template<typename TA, typename TB, typename TInner, typename TC>
+    std::vector<lens_step> lens_composition<TA, TB, TInner, TC>::steps(const void *context) {
+        auto const& composition = *static_cast<const lens_composition *>(context);
+        auto steps = composition._left.steps();
+        steps.push_back(nested_record<TB, TInner>::step);
+        auto const right = composition._right.steps();
+        steps.insert(steps.end(), right.begin(), right.end());
+        return steps;
+    }
+
+    template<typename TA, typename TB, typename TInner, typename TC>
+    std::shared_ptr<const void> lens_composition<TA, TB, TInner, TC>::share(const void *context) {
+        return static_cast<const lens_composition *>(context)->shared_from_this();
     }
 
-    template<typename TA, typename TB, typename TC>
-    inline lens<TA, TC> operator>>(const lens<TA, TB> &left, const lens<TB, TC> &right) {
-        return lens<TA, TC>(
-                [=](TA record) { return right.get(left.get(record)); },
-                [=](TA record, const std::shared_ptr<TC> &value) {
-                    return left.set(record, right.set(left.get(record), value));
-                });
+    template<typename TA, typename TB, typename TInner, typename TC>
+    inline lens<TA, TC> operator>>(const lens_ref<TA, TB> &left, const lens_ref<TInner, TC> &right) {
+        return lens_composition<TA, TB, TInner, TC>::compose(left, right);
     }
-}
\ No newline at end of file
+}
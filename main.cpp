@@ -4,14 +4,27 @@
 
 #include <chrono>
 #include <cmath>
+#include <filesystem>
 #include <iostream>
+#include <vector>
 
 #include "immer/set.hpp"
 #include "immer/vector.hpp"
+#include "immer/vector_transient.hpp"
 
 #include "atom.h"
 #include "collection_utils.h"
+#include "footprint.h"
+#include "freeze.h"
+#include "merge.h"
+#include "partitioned_set.h"
+#include "query.h"
+#include "reclaimer.h"
+#include "sort.h"
+#include "record_store.h"
+#include "subscriptions.h"
 #include "tagged.h"
+#include "tagged_union.h"
 #include "record.h"
 
 constexpr aeternum::atom apples("apples");
@@ -34,8 +47,8 @@ int fruit_count(const aeternum::tagged_untyped& tagged)
 namespace contact {
     constexpr aeternum::atom tag("contact");
 
-    const aeternum::field_name<std::string> telephone_("telephone");
-    const aeternum::field_name<std::string> email_("email");
+    constexpr aeternum::field_name<std::string> telephone_("telephone");
+    constexpr aeternum::field_name<std::string> email_("email");
 
     using record =
         aeternum::fields<std::string, std::string>
@@ -46,9 +59,9 @@ namespace contact {
 namespace person {
     constexpr aeternum::atom tag("person");
 
-    const aeternum::field_name<std::string> name_("name");
-    const aeternum::field_name<uint8_t> age_("age");
-    const aeternum::field_name<contact::record::tagged> contact_("contact");
+    constexpr aeternum::field_name<std::string> name_("name");
+    constexpr aeternum::field_name<uint8_t> age_("age");
+    constexpr aeternum::field_name<contact::record::tagged> contact_("contact");
 
     using record =
         aeternum::fields<std::string, uint8_t, contact::record::tagged>
@@ -58,7 +71,7 @@ namespace person {
 namespace circle {
     constexpr aeternum::atom tag("circle");
 
-    const aeternum::field_name<double> radius_("radius");
+    constexpr aeternum::field_name<double> radius_("radius");
 
     using record =
         aeternum::fields<double>
@@ -68,21 +81,23 @@ namespace circle {
 namespace rectangle {
     constexpr aeternum::atom tag("rectangle");
 
-    const aeternum::field_name<double> width_("width");
-    const aeternum::field_name<double> height_("height");
+    constexpr aeternum::field_name<double> width_("width");
+    constexpr aeternum::field_name<double> height_("height");
 
     using record =
         aeternum::fields<double, double>
             ::record<tag, width_, height_>;
 }
 
+using shape = aeternum::tagged_union<circle::record, rectangle::record>;
+
 namespace music {
     namespace song {
         constexpr aeternum::atom tag("song");
 
-        const aeternum::field_name<std::string> name_("name");
-        const aeternum::field_name<std::string> artist_("artist");
-        const aeternum::field_name<uint16_t> duration_("duration");
+        constexpr aeternum::field_name<std::string> name_("name");
+        constexpr aeternum::field_name<std::string> artist_("artist");
+        constexpr aeternum::field_name<uint16_t> duration_("duration");
 
         using record =
             aeternum::fields<std::string, std::string, uint16_t>
@@ -99,16 +114,16 @@ namespace music {
             bool operator==(const line& other) const { return text == other.text && timestamp == other.timestamp; }
         };
 
-        const aeternum::field_name<immer::vector<line>> lines_("lines");
-        const aeternum::field_name<std::string> author_("author");
+        constexpr aeternum::field_name<aeternum::hashed_vector<line>> lines_("lines");
+        constexpr aeternum::field_name<std::string> author_("author");
 
         using record =
-            aeternum::fields<immer::vector<line>, std::string>
+            aeternum::fields<aeternum::hashed_vector<line>, std::string>
                 ::record<tag, lines_, author_>;
     }
 
     namespace metadata {
-        const aeternum::field_name<music::lyrics::record::tagged> lyrics_("lyrics");
+        constexpr aeternum::field_name<music::lyrics::record::tagged> lyrics_("lyrics");
     }
 }
 
@@ -209,6 +224,20 @@ double area(const aeternum::tagged_untyped& shape) {
     throw std::logic_error("Unknown shape");
 }
 
+double area(const shape& shape) {
+    return shape.visit([](const auto& record) {
+        if constexpr (std::is_same<typename std::decay_t<decltype(record)>::record_type, circle::record>::value)
+        {
+            auto const r = record[circle::radius_];
+            return M_PI * r * r;
+        }
+        else
+        {
+            return record[rectangle::width_] * record[rectangle::height_];
+        }
+    });
+}
+
 int main()
 {
     const auto four_apples = aeternum::make_tagged(apples, 4);
@@ -268,6 +297,100 @@ int main()
               << ", age: " << +junior_new_email[person::age_]
               << ", email: " << junior_new_email[person::contact_][contact::email_] << std::endl;
 
+    auto jimmy = person::record::make("Jimmy Smith", 8, contact::record::make("24680", "jimmy@email.com"));
+    auto const jimmy_contact = &*jimmy[person::contact_];
+    jimmy = std::move(jimmy) | person_email_.set("jimmy@school.edu");
+    std::cout << jimmy[person::name_] << "'s email changed to " << jimmy[person::contact_][contact::email_]
+              << (&*jimmy[person::contact_] == jimmy_contact ? " in place" : " in a copy") << std::endl;
+
+    std::cout << std::endl;
+
+    auto const contacts = immer::vector<contact::record::tagged> {
+        jane_contact,
+        contact::record::make("55555", "junior@email.com")
+    };
+    auto const people = immer::vector<person::record::tagged> { john, junior_new_email };
+    for (auto& match : aeternum::hash_join(people, person_email_, contacts, contact::email_))
+    {
+        std::cout << match.first[person::name_] << " can also be reached on "
+                  << match.second[contact::telephone_] << std::endl;
+    }
+
+    std::cout << std::endl;
+
+    auto const older_john = john | person::age_.set(43);
+    auto const reachable_john = john | person_email_.set("john@work.com");
+    auto const merged_john = aeternum::merge3(john, older_john, reachable_john);
+    std::cout << "Merged John is " << +merged_john.value[person::age_] << " with email "
+              << merged_john.value[person::contact_][contact::email_] << std::endl;
+
+    auto const resolvers = aeternum::merge_resolvers().add(person::age_, aeternum::resolve::sum());
+    auto const renamed_john = aeternum::merge3(
+            john,
+            older_john | person::name_.set("Jon Smith") | person_email_.set("jon@email.com"),
+            john | person::age_.set(44) | person::name_.set("Johnathan Smith") | person_email_.set("jon@email.com"),
+            resolvers);
+    std::cout << "Merging two renames ages John to " << +renamed_john.value[person::age_] << " and conflicts on:";
+    for (auto& conflict : renamed_john.conflicts)
+    {
+        for (auto& key : conflict.path)
+        {
+            std::cout << " " << key.name;
+        }
+    }
+    std::cout << std::endl;
+
+    std::cout << std::endl;
+
+    aeternum::subscriptions subscriptions;
+    subscriptions.subscribe(person_email_, [](const std::string *old_email, const std::string *new_email) {
+        std::cout << "Email changed from " << *old_email << " to " << *new_email << std::endl;
+    });
+    subscriptions.subscribe(person::age_, [](const uint8_t *old_age, const uint8_t *new_age) {
+        std::cout << "Age changed from " << +*old_age << " to " << +*new_age << std::endl;
+    });
+    subscriptions.publish(junior, junior_new_email);
+
+    std::cout << std::endl;
+
+    aeternum::footprint footprint;
+    footprint.add_root(john);
+    footprint.add_root(junior_new_email);
+
+    auto const retained = footprint.total();
+    std::cout << "John and junior retain " << retained.total << " bytes, "
+              << retained.shared << " of them shared" << std::endl;
+    for (auto& tag : footprint.by_tag())
+    {
+        std::cout << "  " << tag.first.name << ": " << tag.second.unique << " unique, "
+                  << tag.second.shared << " shared" << std::endl;
+    }
+
+    auto const frozen = aeternum::freeze(immer::vector<person::record::tagged> { john, junior });
+    std::cout << "Frozen " << frozen[1][person::name_] << " can be reached at " << *person_email_.get(frozen[1])
+              << ", sharing John's contact: " << std::boolalpha
+              << (&*frozen[0][person::contact_] == &*frozen[1][person::contact_]) << std::endl;
+
+    std::cout << std::endl;
+
+    auto const people_directory = std::filesystem::temp_directory_path() / "aeternum-people";
+    std::filesystem::remove_all(people_directory);
+    {
+        aeternum::record_store<std::string, person::record> people(people_directory);
+        people.put("john", john);
+        people.put("junior", junior_new_email);
+        people.checkpoint();
+        people.commit(people.put("jane", person::record::make("Jane Bond", 35, contact::record::tagged(jane_contact))));
+    }
+
+    std::filesystem::resize_file(people_directory / "log", std::filesystem::file_size(people_directory / "log") - 1);
+    {
+        aeternum::record_store<std::string, person::record> people(people_directory);
+        auto const recovered = people.snapshot();
+        std::cout << "Recovered " << recovered.size() << " people after a torn write, junior's email is "
+                  << (*recovered.find("junior"))[person::contact_][contact::email_] << std::endl;
+    }
+
     std::cout << std::endl;
 
     immer::set<aeternum::tagged<aeternum::untyped_record>> shapes{};
@@ -281,6 +404,49 @@ int main()
                   << " of area: " << area(shape) << std::endl;
     }
 
+    aeternum::lens<aeternum::tagged<aeternum::untyped_record>, double> diameter_(
+            [](const aeternum::tagged<aeternum::untyped_record> &circle) {
+                return std::make_shared<const double>(2 * circle[circle::radius_]);
+            },
+            [](const aeternum::tagged<aeternum::untyped_record> &circle, const std::shared_ptr<const double> &diameter) {
+                return circle::radius_.set(circle, *diameter / 2);
+            });
+    auto const wide_circle = circle::record::make(3.0) | diameter_.set(10.0);
+    std::cout << "A circle widened to diameter " << *diameter_.get(wide_circle)
+              << " has radius " << wide_circle[circle::radius_] << std::endl;
+
+    std::vector<shape> closed_shapes(shapes.begin(), shapes.end());
+    closed_shapes.push_back(circle::record::make(1.0));
+
+    double total_area = 0.0;
+    for (auto& shape : closed_shapes)
+    {
+        total_area += area(shape);
+    }
+    std::cout << "The " << closed_shapes.size() << " closed shapes cover an area of " << total_area
+              << ", the last is a " << closed_shapes.back().to_tagged().get_tag().name
+              << " of area " << area(closed_shapes.back().to_tagged()) << std::endl;
+
+    aeternum::partitioned_set<> partitioned_shapes;
+    for (auto& shape : shapes)
+    {
+        partitioned_shapes = partitioned_shapes.insert(shape);
+    }
+    partitioned_shapes = partitioned_shapes
+            .insert(circle::record::make(2.0))
+            .insert(rectangle::record::make(1.0, 2.0))
+            .erase(circle::record::make(3.0));
+
+    double circle_area = 0.0, rectangle_area = 0.0;
+    partitioned_shapes.for_each<circle::record>([&](const circle::record& circle) {
+        circle_area += M_PI * circle[circle::radius_] * circle[circle::radius_];
+    });
+    partitioned_shapes.for_each<rectangle::record>([&](const rectangle::record& rectangle) {
+        rectangle_area += rectangle[rectangle::width_] * rectangle[rectangle::height_];
+    });
+    std::cout << "Partitioned " << partitioned_shapes.size() << " shapes: circles cover " << circle_area
+              << ", rectangles cover " << rectangle_area << std::endl;
+
     std::cout << std::endl;
 
     auto never_gonna = music::song::record::make(
@@ -288,7 +454,7 @@ int main()
         "Rick Astley",
         183);
 
-    never_gonna = never_gonna
+    never_gonna = std::move(never_gonna)
             | music::metadata::lyrics_.set(
                 music::lyrics::record::make(
                     immer::vector<music::lyrics::line> {
@@ -303,5 +469,85 @@ int main()
         std::cout << kvp.first.name << ", ";
     }
 
+    std::cout << std::endl << "A song's schema declares fields: ";
+    for (auto& name : music::song::record::schema.names())
+    {
+        std::cout << name.name << ", ";
+    }
+
+    auto const field = std::string("artist");
+    never_gonna->visit_field(field, [](const auto& name, const auto& value) {
+        if constexpr (std::is_same<std::decay_t<decltype(value)>, std::string>::value)
+        {
+            std::cout << std::endl << "Looked up " << name.key().name << " by name: " << value;
+        }
+    });
+
+    std::cout << std::endl << std::endl;
+
+    auto const& lines = never_gonna[music::metadata::lyrics_][music::lyrics::lines_];
+    auto const retimed = lines.set(1, { "Never gonna let you down", 27 });
+    std::cout << "Retimed lyrics hash: " << retimed.get_hash()
+              << ", original hash: " << lines.get_hash()
+              << ", equal: " << (retimed == lines) << std::endl;
+
+    std::cout << std::endl;
+
+    auto const songs = music::song::record::make_many(
+        2,
+        std::vector<std::string> { "Never Gonna Give You Up", "Together Forever", "She Wants to Dance with Me" },
+        std::vector<std::string> { "Rick Astley", "Rick Astley", "Rick Astley" },
+        std::vector<uint16_t> { 213, 205, 199 });
+
+    for (auto& song : songs)
+    {
+        std::cout << "Built " << song[music::song::name_]
+                  << " by " << song[music::song::artist_]
+                  << " (" << song[music::song::duration_] << "s)" << std::endl;
+    }
+
+    auto const catalogue = songs
+            .push_back(music::song::record::make("Take On Me", "a-ha", 225))
+            .push_back(music::song::record::make("The Sun Always Shines on T.V.", "a-ha", 306));
+
+    auto const total_duration = aeternum::group_by(catalogue, music::song::artist_, aeternum::aggregate::sum(music::song::duration_));
+    auto const longest = aeternum::group_by(catalogue, music::song::artist_, aeternum::aggregate::max(music::song::duration_));
+    auto const titles = aeternum::group_by(catalogue, music::song::artist_, aeternum::aggregate::reduce(
+            music::song::name_, std::string(), [](const std::string& lhs, const std::string& rhs) {
+                return lhs.empty() ? rhs : rhs.empty() ? lhs : std::min(lhs, rhs);
+            }));
+    for (auto& artist : aeternum::group_by(catalogue, music::song::artist_, aeternum::aggregate::count()))
+    {
+        std::cout << artist.first << " has " << artist.second << " songs lasting " << *total_duration.find(artist.first)
+                  << "s, the longest " << *longest.find(artist.first) << "s, first title " << *titles.find(artist.first) << std::endl;
+    }
+
+    std::cout << "Longest first:";
+    for (auto& song : aeternum::sort_by(catalogue, music::song::duration_, aeternum::sort_order::descending))
+    {
+        std::cout << " " << song[music::song::name_] << " (" << song[music::song::duration_] << "s)";
+    }
+    std::cout << std::endl;
+    std::cout << "By title: " << aeternum::sort_by(catalogue, music::song::name_)[0][music::song::name_] << " first" << std::endl;
+
+    std::cout << std::endl;
+
+    aeternum::reclaimer reclaimer(64 * 1024 * 1024);
+    {
+        auto lines = immer::vector<music::lyrics::line>{}.transient();
+        for (uint16_t i = 0; i < 10000; i++)
+        {
+            lines.push_back({ "Never gonna run around and desert you", i });
+        }
+
+        auto const lyrics = reclaimer.adopt(
+            music::lyrics::record::make(lines.persistent(), "rickroller89"),
+            lines.size() * sizeof(music::lyrics::line));
+
+        std::cout << "Adopted lyrics with " << lyrics[music::lyrics::lines_].size() << " lines" << std::endl;
+    }
+    reclaimer.flush();
+    std::cout << "Lyrics released on the reclaimer thread, " << reclaimer.queued_bytes() << " bytes pending" << std::endl;
+
     return 0;
 }
\ No newline at end of file
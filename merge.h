@@ -0,0 +1,233 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "immer/algorithm.hpp"
+#include "immer/map.hpp"
+
+#include "atom.h"
+#include "lens.h"
+#include "record.h"
+#include "tagged.h"
+
+namespace aeternum {
+
+    struct merge_conflict {
+        std::vector<atom> path;
+    };
+
+    template<typename TRecord>
+    struct merge_result {
+        tagged<TRecord> value;
+        std::vector<merge_conflict> conflicts;
+
+        bool clean() const { return conflicts.empty(); }
+    };
+
+    // Per-field resolvers for fields that both sides changed to different values, keyed by lens path so
+    // that nested fields can be resolved independently. A resolver is called as resolver(base, ours,
+    // theirs) and returns the merged value.
+    class merge_resolvers {
+    public:
+        template<typename T, typename TResolver>
+        merge_resolvers &add(const lens_ref<tagged<untyped_record>, T> &field, TResolver resolver);
+
+        using resolver = std::function<std::shared_ptr<void>(const void *, const void *, const void *)>;
+
+        inline const resolver *find(const std::vector<atom> &path) const;
+
+    private:
+        std::map<std::vector<atom>, resolver> _resolvers;
+    };
+
+    namespace resolve {
+
+        // Keeps our value; this is last-writer-wins when ours is committed on top of theirs.
+        struct ours {
+            template<typename T>
+            T operator()(const T &, const T &ours, const T &) const { return ours; }
+        };
+
+        struct theirs {
+            template<typename T>
+            T operator()(const T &, const T &, const T &theirs) const { return theirs; }
+        };
+
+        // Applies both sides' deltas, for counters.
+        struct sum {
+            template<typename T>
+            T operator()(const T &base, const T &ours, const T &theirs) const {
+                return static_cast<T>(ours + theirs - base);
+            }
+        };
+    }
+
+    // Three-way merge of two versions derived from a common base. Changed fields are found by diffing the
+    // field maps, which skips everything still shared with the base, and edits to different fields are
+    // combined. Where both sides changed a field, equal values are accepted, then a resolver registered
+    // for the field's path is applied, then nested records are merged recursively; anything left is
+    // reported as a conflict and keeps our value.
+    template<typename TRecord>
+    merge_result<TRecord> merge3(const tagged<TRecord> &base, const tagged<TRecord> &ours, const tagged<TRecord> &theirs,
+                                 const merge_resolvers &resolvers = merge_resolvers());
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : MERGE
+// --------------------------------------------------------------------------------------------
+
+    template<typename T, typename TResolver>
+    merge_resolvers &merge_resolvers::add(const lens_ref<tagged<untyped_record>, T> &field, TResolver resolver) {
+        if (field.path().empty()) {
+            throw std::invalid_argument("merge_resolvers: lens has no field path");
+        }
+
+        _resolvers[field.path()] = [resolver](const void *base, const void *ours, const void *theirs) {
+            return std::static_pointer_cast<void>(std::make_shared<T>(resolver(
+                    *static_cast<const T *>(base), *static_cast<const T *>(ours), *static_cast<const T *>(theirs))));
+        };
+        return *this;
+    }
+
+    const merge_resolvers::resolver *merge_resolvers::find(const std::vector<atom> &path) const {
+        auto const found = _resolvers.find(path);
+        return found == _resolvers.end() ? nullptr : &found->second;
+    }
+
+    template<typename TRecord>
+    tagged<TRecord> merge_records(const tagged<TRecord> &base, const tagged<TRecord> &ours, const tagged<TRecord> &theirs,
+                                  const merge_resolvers &resolvers, const std::vector<atom> &prefix,
+                                  std::vector<merge_conflict> &conflicts);
+
+    template<typename T, typename = void>
+    struct merge_field {
+        static std::shared_ptr<void> merge(const T &, const T &, const T &, const merge_resolvers &,
+                                           const std::vector<atom> &path, std::vector<merge_conflict> &conflicts) {
+            conflicts.push_back({ path });
+            return nullptr;
+        }
+    };
+
+    template<typename TRecord>
+    struct merge_field<tagged<TRecord>, std::void_t<typename TRecord::field_types>> {
+        static std::shared_ptr<void> merge(const tagged<TRecord> &base, const tagged<TRecord> &ours, const tagged<TRecord> &theirs,
+                                           const merge_resolvers &resolvers, const std::vector<atom> &path,
+                                           std::vector<merge_conflict> &conflicts) {
+            if (!base || !ours || !theirs
+                || !(base.get_tag() == ours.get_tag()) || !(base.get_tag() == theirs.get_tag())) {
+                conflicts.push_back({ path });
+                return nullptr;
+            }
+            return std::make_shared<tagged<TRecord>>(merge_records(base, ours, theirs, resolvers, path, conflicts));
+        }
+    };
+
+    template<typename TRecord>
+    tagged<TRecord> merge_records(const tagged<TRecord> &base, const tagged<TRecord> &ours, const tagged<TRecord> &theirs,
+                                  const merge_resolvers &resolvers, const std::vector<atom> &prefix,
+                                  std::vector<merge_conflict> &conflicts) {
+        auto const& base_fields = base->raw_data();
+        auto const& our_fields = ours->raw_data();
+        auto const& their_fields = theirs->raw_data();
+        if (our_fields.identity() == base_fields.identity()) {
+            return theirs;
+        }
+        if (their_fields.identity() == base_fields.identity() || their_fields.identity() == our_fields.identity()) {
+            return ours;
+        }
+
+        std::unordered_set<atom> ours_changed;
+        auto const mark = [&](const auto &field) { ours_changed.insert(field.first); };
+        immer::diff(base_fields, our_fields, immer::make_differ(mark, mark, [&](const auto &, const auto &field) { mark(field); }));
+
+        auto merged = our_fields;
+        std::vector<atom> contested;
+        auto const take_theirs = [&](const auto &field) {
+            auto const ours_value = our_fields.find(field.first);
+            if (!ours_changed.count(field.first)) {
+                merged = merged.set(field.first, field.second);
+            } else if (!ours_value || *ours_value != field.second) {
+                contested.push_back(field.first);
+            }
+        };
+        immer::diff(base_fields, their_fields, immer::make_differ(
+                take_theirs,
+                [&](const auto &field) {
+                    if (!ours_changed.count(field.first)) {
+                        merged = merged.erase(field.first);
+                    } else if (our_fields.find(field.first)) {
+                        contested.push_back(field.first);
+                    }
+                },
+                [&](const auto &, const auto &field) { take_theirs(field); }));
+
+        for (auto& key : contested) {
+            auto path = prefix;
+            path.push_back(key);
+
+            auto const base_value = base_fields.find(key);
+            auto const ours_value = our_fields.find(key);
+            auto const theirs_value = their_fields.find(key);
+            if (!base_value || !ours_value || !theirs_value) {
+                conflicts.push_back({ path });
+                continue;
+            }
+
+            bool typed = false;
+            ours->for_each_field([&](const auto &name, const auto &value) {
+                using field_type = std::decay_t<decltype(value)>;
+                if (typed || !(name.key() == key)) {
+                    return;
+                }
+                typed = true;
+
+                auto const& base_field = *static_cast<const field_type *>(base_value->get());
+                auto const& their_field = *static_cast<const field_type *>(theirs_value->get());
+                if (std::equal_to<field_type>{}(value, their_field)) {
+                    return;
+                }
+
+                std::shared_ptr<void> resolved;
+                if (auto const resolver = resolvers.find(path)) {
+                    resolved = (*resolver)(&base_field, &value, &their_field);
+                } else {
+                    resolved = merge_field<field_type>::merge(base_field, value, their_field, resolvers, path, conflicts);
+                }
+                if (resolved) {
+                    merged = merged.set(key, std::move(resolved));
+                }
+            });
+
+            if (!typed) {
+                if (auto const resolver = resolvers.find(path)) {
+                    merged = merged.set(key, (*resolver)(base_value->get(), ours_value->get(), theirs_value->get()));
+                } else {
+                    conflicts.push_back({ path });
+                }
+            }
+        }
+
+        return make_tagged(ours.get_tag(), TRecord(ours->with_raw_data(std::move(merged))));
+    }
+
+    template<typename TRecord>
+    merge_result<TRecord> merge3(const tagged<TRecord> &base, const tagged<TRecord> &ours, const tagged<TRecord> &theirs,
+                                 const merge_resolvers &resolvers) {
+        if (!base || !ours || !theirs) {
+            throw std::invalid_argument("merge3: cannot merge empty records");
+        }
+        if (!(base.get_tag() == ours.get_tag()) || !(base.get_tag() == theirs.get_tag())) {
+            throw std::invalid_argument("merge3: records have different tags");
+        }
+
+        std::vector<merge_conflict> conflicts;
+        auto merged = merge_records(base, ours, theirs, resolvers, {}, conflicts);
+        return { std::move(merged), std::move(conflicts) };
+    }
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+
+#include "immer/map.hpp"
+#include "immer/vector.hpp"
+
+#include "atom.h"
+#include "record.h"
+#include "tagged.h"
+
+namespace aeternum {
+
+    // A persistent set of tagged values partitioned by tag. Each tag owns a homogeneous segment, so batch
+    // visits run over one record type at a time with no tag test or cast per element. A segment is an
+    // immer::vector of handles in insertion order, so visits walk contiguous runs of handles, though each
+    // handle still points to its own record on the heap. An index from value to position serves count and
+    // erase, which moves the segment's last value into the erased slot; insert and erase are logarithmic.
+    template<typename T = untyped_record>
+    class partitioned_set {
+    public:
+        using value_type = tagged<T>;
+        using segment = immer::vector<value_type>;
+        using size_type = std::size_t;
+
+        class const_iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = partitioned_set::value_type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const value_type *;
+            using reference = const value_type &;
+
+            const_iterator() = default;
+
+            reference operator*() const { return *_item; }
+            pointer operator->() const { return &*_item; }
+
+            inline const_iterator &operator++();
+
+            const_iterator operator++(int) {
+                auto result = *this;
+                ++*this;
+                return result;
+            }
+
+            bool operator==(const const_iterator &rhs) const {
+                return _segment == rhs._segment && (_segment == _last || _item == rhs._item);
+            }
+
+            bool operator!=(const const_iterator &rhs) const { return !(*this == rhs); }
+
+        private:
+            using segment_iterator = typename immer::map<atom, segment>::const_iterator;
+
+            const_iterator(segment_iterator segment, segment_iterator last);
+
+            inline void skip_empty();
+
+            segment_iterator _segment;
+            segment_iterator _last;
+            typename segment::const_iterator _item;
+
+            friend class partitioned_set;
+        };
+
+        using iterator = const_iterator;
+
+        size_type size() const { return _positions.size(); }
+
+        bool empty() const { return _positions.size() == 0; }
+
+        const_iterator begin() const { return const_iterator(_segments.begin(), _segments.end()); }
+
+        const_iterator end() const { return const_iterator(_segments.end(), _segments.end()); }
+
+        inline size_type count(const value_type &value) const;
+
+        inline partitioned_set insert(value_type value) const;
+
+        inline partitioned_set erase(const value_type &value) const;
+
+        inline const segment &segment_of(const atom &tag) const;
+
+        template<typename TVisitor>
+        void for_each_segment(TVisitor &&visitor) const;
+
+        template<typename TRecord, typename TVisitor>
+        void for_each(TVisitor &&visitor) const;
+
+    private:
+        immer::map<atom, segment> _segments;
+        immer::map<value_type, size_type> _positions;
+
+        static inline const segment _empty{};
+    };
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : PARTITIONED SET
+// --------------------------------------------------------------------------------------------
+
+    template<typename T>
+    typename partitioned_set<T>::size_type partitioned_set<T>::count(const value_type &value) const {
+        return _positions.count(value);
+    }
+
+    template<typename T>
+    partitioned_set<T> partitioned_set<T>::insert(value_type value) const {
+        if (_positions.count(value)) {
+            return *this;
+        }
+
+        auto const tag = value.get_tag();
+        auto const& current = segment_of(tag);
+        auto result = *this;
+        result._positions = _positions.set(value, current.size());
+        result._segments = _segments.set(tag, current.push_back(std::move(value)));
+        return result;
+    }
+
+    template<typename T>
+    partitioned_set<T> partitioned_set<T>::erase(const value_type &value) const {
+        auto const position = _positions.find(value);
+        if (!position) {
+            return *this;
+        }
+
+        auto const tag = value.get_tag();
+        auto const& current = segment_of(tag);
+        auto result = *this;
+        result._positions = _positions.erase(value);
+        if (current.size() == 1) {
+            result._segments = _segments.erase(tag);
+            return result;
+        }
+
+        auto updated = current;
+        if (*position != current.size() - 1) {
+            auto const last = current.back();
+            updated = std::move(updated).set(*position, last);
+            result._positions = std::move(result._positions).set(last, *position);
+        }
+        result._segments = _segments.set(tag, updated.take(current.size() - 1));
+        return result;
+    }
+
+    template<typename T>
+    const typename partitioned_set<T>::segment &partitioned_set<T>::segment_of(const atom &tag) const {
+        auto const found = _segments.find(tag);
+        return found ? *found : _empty;
+    }
+
+    template<typename T>
+    template<typename TVisitor>
+    void partitioned_set<T>::for_each_segment(TVisitor &&visitor) const {
+        for (auto& kvp : _segments) {
+            visitor(kvp.first, kvp.second);
+        }
+    }
+
+    template<typename T>
+    template<typename TRecord, typename TVisitor>
+    void partitioned_set<T>::for_each(TVisitor &&visitor) const {
+        for (auto& value : segment_of(TRecord::record_tag)) {
+            visitor(static_cast<const TRecord &>(*value));
+        }
+    }
+
+// --------------------------------------------------------------------------------------------
+//                     IMPLEMENTATION : PARTITIONED SET ITERATOR
+// --------------------------------------------------------------------------------------------
+
+    template<typename T>
+    partitioned_set<T>::const_iterator::const_iterator(segment_iterator segment, segment_iterator last)
+            : _segment(segment), _last(last) {
+        skip_empty();
+    }
+
+    template<typename T>
+    typename partitioned_set<T>::const_iterator &partitioned_set<T>::const_iterator::operator++() {
+        if (++_item == _segment->second.end()) {
+            ++_segment;
+            skip_empty();
+        }
+        return *this;
+    }
+
+    template<typename T>
+    void partitioned_set<T>::const_iterator::skip_empty() {
+        for (; _segment != _last; ++_segment) {
+            if (!_segment->second.empty()) {
+                _item = _segment->second.begin();
+                return;
+            }
+        }
+    }
+}
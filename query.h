@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "immer/map.hpp"
+#include "immer/map_transient.hpp"
+#include "immer/vector.hpp"
+#include "immer/vector_transient.hpp"
+
+#include "lens.h"
+#include "record.h"
+#include "tagged.h"
+
+namespace aeternum {
+
+    template<typename TKey>
+    using key_lens = lens_ref<tagged<untyped_record>, TKey>;
+
+    // Aggregates fold the records of a group into a state, and per-thread states are then combined, so
+    // user-defined reducers must be associative. Each partial state starts from the first value it sees,
+    // so the result does not depend on the number of threads.
+    namespace aggregate {
+
+        class count {
+        public:
+            using state_type = std::size_t;
+            using result_type = std::size_t;
+
+            state_type init() const { return 0; }
+
+            void accumulate(state_type &state, const tagged<untyped_record> &) const { state++; }
+
+            void combine(state_type &state, const state_type &other) const { state += other; }
+
+            result_type result(const state_type &state) const { return state; }
+        };
+
+        template<typename T>
+        class sum {
+        public:
+            using state_type = decltype(std::declval<T>() + std::declval<T>());
+            using result_type = state_type;
+
+            explicit sum(const key_lens<T> &field) : _field(field) {}
+
+            state_type init() const { return state_type{}; }
+
+            void accumulate(state_type &state, const tagged<untyped_record> &record) const {
+                if (auto const value = _field.get(record)) {
+                    state += *value;
+                }
+            }
+
+            void combine(state_type &state, const state_type &other) const { state += other; }
+
+            result_type result(const state_type &state) const { return state; }
+
+        private:
+            lens<tagged<untyped_record>, T> _field;
+        };
+
+        template<typename T, typename Compare>
+        class extremum {
+        public:
+            using state_type = std::optional<T>;
+            using result_type = T;
+
+            explicit extremum(const key_lens<T> &field) : _field(field) {}
+
+            state_type init() const { return std::nullopt; }
+
+            void accumulate(state_type &state, const tagged<untyped_record> &record) const {
+                if (auto const value = _field.get(record)) {
+                    combine(state, *value);
+                }
+            }
+
+            void combine(state_type &state, const state_type &other) const {
+                if (other && (!state || Compare{}(*other, *state))) {
+                    state = other;
+                }
+            }
+
+            result_type result(const state_type &state) const { return state.value_or(T{}); }
+
+        private:
+            lens<tagged<untyped_record>, T> _field;
+        };
+
+        template<typename T>
+        class min : public extremum<T, std::less<T>> {
+        public:
+            explicit min(const key_lens<T> &field) : extremum<T, std::less<T>>(field) {}
+        };
+
+        template<typename T>
+        class max : public extremum<T, std::greater<T>> {
+        public:
+            explicit max(const key_lens<T> &field) : extremum<T, std::greater<T>>(field) {}
+        };
+
+        // Folds the values of a field with an associative reducer. identity is only the result of a group
+        // that has no values, so it need not be an identity element of the reducer.
+        template<typename T, typename TReducer>
+        class reduce {
+        public:
+            using state_type = std::optional<T>;
+            using result_type = T;
+
+            reduce(const key_lens<T> &field, T identity, TReducer reducer)
+                    : _field(field), _identity(std::move(identity)), _reducer(std::move(reducer)) {}
+
+            state_type init() const { return std::nullopt; }
+
+            void accumulate(state_type &state, const tagged<untyped_record> &record) const {
+                if (auto const value = _field.get(record)) {
+                    combine(state, *value);
+                }
+            }
+
+            void combine(state_type &state, const state_type &other) const {
+                if (!other) {
+                    return;
+                }
+                state = state ? _reducer(*state, *other) : *other;
+            }
+
+            result_type result(const state_type &state) const { return state.value_or(_identity); }
+
+        private:
+            lens<tagged<untyped_record>, T> _field;
+            T _identity;
+            TReducer _reducer;
+        };
+
+        template<typename T, typename U, typename TReducer>
+        reduce(const key_lens<T> &, U, TReducer) -> reduce<T, TReducer>;
+    }
+
+    // Inner equi-join of two collections of tagged records. The right collection is hashed into one
+    // partition per thread, with both the partitioning and the table builds running in parallel, and the
+    // left collection is then probed in parallel. Pairs come out in left order, so put the smaller
+    // collection on the right. Records without a key are dropped.
+    template<typename TLeft, typename TRight, typename TKey>
+    immer::vector<std::pair<typename TLeft::value_type, typename TRight::value_type>> hash_join(
+            const TLeft &left, const key_lens<TKey> &left_key,
+            const TRight &right, const key_lens<TKey> &right_key,
+            std::size_t threads = std::thread::hardware_concurrency());
+
+    // Groups a collection of tagged records by key and aggregates each group. Every thread folds its slice
+    // into a private table, and the partial states are then merged in parallel, one key partition per
+    // thread. Records without a key are dropped.
+    template<typename TCollection, typename TKey, typename TAggregate>
+    immer::map<TKey, typename TAggregate::result_type> group_by(
+            const TCollection &items, const key_lens<TKey> &key, const TAggregate &aggregate,
+            std::size_t threads = std::thread::hardware_concurrency());
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : QUERY
+// --------------------------------------------------------------------------------------------
+
+    inline const tagged<untyped_record> &as_untyped(const tagged<untyped_record> &record) {
+        return record;
+    }
+
+    template<typename TRecord>
+    tagged<untyped_record> as_untyped(const tagged<TRecord> &record) {
+        return record;
+    }
+
+    template<typename TCollection>
+    std::vector<const typename TCollection::value_type *> gather(const TCollection &items) {
+        std::vector<const typename TCollection::value_type *> result;
+        for (auto& item : items) {
+            result.push_back(&item);
+        }
+        return result;
+    }
+
+    template<typename TWork>
+    void run_parallel(std::size_t threads, TWork &&work) {
+        std::vector<std::exception_ptr> errors(threads);
+        auto run = [&](std::size_t thread) {
+            try {
+                work(thread);
+            } catch (...) {
+                errors[thread] = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (std::size_t thread = 1; thread < threads; thread++) {
+            workers.emplace_back(run, thread);
+        }
+        run(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        for (auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    template<typename TLeft, typename TRight, typename TKey>
+    immer::vector<std::pair<typename TLeft::value_type, typename TRight::value_type>> hash_join(
+            const TLeft &left, const key_lens<TKey> &left_key,
+            const TRight &right, const key_lens<TKey> &right_key,
+            std::size_t threads) {
+        using result_type = std::pair<typename TLeft::value_type, typename TRight::value_type>;
+        using table = std::unordered_multimap<TKey, const typename TRight::value_type *>;
+        using keyed = std::pair<std::shared_ptr<const TKey>, const typename TRight::value_type *>;
+
+        auto const left_items = gather(left);
+        auto const right_items = gather(right);
+        threads = std::max<std::size_t>(1, std::min(threads, std::max(left_items.size(), right_items.size())));
+
+        std::vector<std::vector<std::vector<keyed>>> buckets(threads, std::vector<std::vector<keyed>>(threads));
+        run_parallel(threads, [&](std::size_t thread) {
+            for (auto i = thread; i < right_items.size(); i += threads) {
+                if (auto key = right_key.get(as_untyped(*right_items[i]))) {
+                    auto const partition = std::hash<TKey>{}(*key) % threads;
+                    buckets[thread][partition].emplace_back(std::move(key), right_items[i]);
+                }
+            }
+        });
+
+        std::vector<table> tables(threads);
+        run_parallel(threads, [&](std::size_t partition) {
+            for (auto& thread_buckets : buckets) {
+                for (auto& entry : thread_buckets[partition]) {
+                    tables[partition].emplace(*entry.first, entry.second);
+                }
+            }
+        });
+
+        const std::size_t chunk_size = (left_items.size() + threads - 1) / threads;
+        std::vector<std::vector<result_type>> matches(threads);
+        run_parallel(threads, [&](std::size_t thread) {
+            const std::size_t first = std::min(left_items.size(), thread * chunk_size);
+            const std::size_t last = std::min(left_items.size(), first + chunk_size);
+            for (auto i = first; i < last; i++) {
+                auto const key = left_key.get(as_untyped(*left_items[i]));
+                if (!key) {
+                    continue;
+                }
+
+                auto const& partition = tables[std::hash<TKey>{}(*key) % threads];
+                auto const range = partition.equal_range(*key);
+                for (auto match = range.first; match != range.second; ++match) {
+                    matches[thread].emplace_back(*left_items[i], *match->second);
+                }
+            }
+        });
+
+        auto result = immer::vector<result_type>().transient();
+        for (auto& thread_matches : matches) {
+            for (auto& match : thread_matches) {
+                result.push_back(std::move(match));
+            }
+        }
+        return result.persistent();
+    }
+
+    template<typename TCollection, typename TKey, typename TAggregate>
+    immer::map<TKey, typename TAggregate::result_type> group_by(
+            const TCollection &items, const key_lens<TKey> &key, const TAggregate &aggregate,
+            std::size_t threads) {
+        using table = std::unordered_map<TKey, typename TAggregate::state_type>;
+
+        auto const records = gather(items);
+        threads = std::max<std::size_t>(1, std::min(threads, records.size()));
+
+        const std::size_t chunk_size = (records.size() + threads - 1) / threads;
+        std::vector<table> partials(threads);
+        run_parallel(threads, [&](std::size_t thread) {
+            const std::size_t first = std::min(records.size(), thread * chunk_size);
+            const std::size_t last = std::min(records.size(), first + chunk_size);
+            for (auto i = first; i < last; i++) {
+                auto const& record = as_untyped(*records[i]);
+                if (auto const group = key.get(record)) {
+                    auto state = partials[thread].try_emplace(*group, aggregate.init()).first;
+                    aggregate.accumulate(state->second, record);
+                }
+            }
+        });
+
+        std::vector<table> merged(threads);
+        run_parallel(threads, [&](std::size_t partition) {
+            for (auto& partial : partials) {
+                for (auto& entry : partial) {
+                    if (std::hash<TKey>{}(entry.first) % threads != partition) {
+                        continue;
+                    }
+
+                    auto const found = merged[partition].find(entry.first);
+                    if (found == merged[partition].end()) {
+                        merged[partition].emplace(entry.first, entry.second);
+                    } else {
+                        aggregate.combine(found->second, entry.second);
+                    }
+                }
+            }
+        });
+
+        auto result = immer::map<TKey, typename TAggregate::result_type>().transient();
+        for (auto& partition : merged) {
+            for (auto& entry : partition) {
+                result.set(entry.first, aggregate.result(entry.second));
+            }
+        }
+        return result.persistent();
+    }
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "tagged.h"
+
+namespace aeternum {
+
+    // Releases values on a background thread so that the destructor cascade of a large record graph
+    // does not run on the thread that dropped the last reference. At most max_queued_bytes worth of
+    // garbage is held at once; anything that would exceed the bound is destroyed synchronously.
+    // A reclaimer must outlive every value adopted by it.
+    class reclaimer {
+    public:
+        inline explicit reclaimer(std::size_t max_queued_bytes);
+
+        reclaimer(const reclaimer& other) = delete;
+        reclaimer& operator=(const reclaimer& other) = delete;
+
+        inline ~reclaimer();
+
+        template<typename T>
+        void retire(T &&value, std::size_t bytes);
+
+        // Returns a handle to the same value that, when its last copy is released, retires the handle it
+        // was made from. The value is only torn down on the background thread if nothing else owns it by
+        // then, so move in the last handle rather than keeping a copy.
+        template<typename T>
+        tagged<T> adopt(tagged<T> value, std::size_t bytes);
+
+        inline void flush();
+
+        inline std::size_t queued_bytes() const;
+
+    private:
+        struct garbage {
+            virtual ~garbage() = default;
+        };
+
+        template<typename T>
+        struct garbage_of : public garbage {
+            explicit garbage_of(T &&value) : value(std::move(value)) {}
+
+            T value;
+        };
+
+        using entry = std::pair<std::unique_ptr<garbage>, std::size_t>;
+
+        inline void run();
+
+        const std::size_t _max_queued_bytes;
+        std::size_t _queued_bytes;
+        std::size_t _in_flight;
+        bool _stopping;
+        std::deque<entry> _queue;
+        mutable std::mutex _mutex;
+        std::condition_variable _has_garbage;
+        std::condition_variable _drained;
+        std::thread _worker;
+    };
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : RECLAIMER
+// --------------------------------------------------------------------------------------------
+
+    reclaimer::reclaimer(std::size_t max_queued_bytes)
+            : _max_queued_bytes(max_queued_bytes),
+              _queued_bytes(0),
+              _in_flight(0),
+              _stopping(false),
+              _worker([this]() { run(); }) {}
+
+    reclaimer::~reclaimer() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _has_garbage.notify_one();
+        _worker.join();
+    }
+
+    template<typename T>
+    void reclaimer::retire(T &&value, std::size_t bytes) {
+        using value_type = typename std::decay<T>::type;
+
+        std::unique_ptr<garbage> item(new garbage_of<value_type>(value_type(std::forward<T>(value))));
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stopping || _queued_bytes + bytes > _max_queued_bytes) {
+                return;
+            }
+            _queued_bytes += bytes;
+            _queue.emplace_back(std::move(item), bytes);
+        }
+        _has_garbage.notify_one();
+    }
+
+    template<typename T>
+    tagged<T> reclaimer::adopt(tagged<T> value, std::size_t bytes) {
+        auto const tag = value.get_tag();
+        auto const data = &*value;
+        return tagged<T>(tag, std::shared_ptr<T>(data, [this, bytes, value = std::move(value)](T *) mutable {
+            retire(std::move(value), bytes);
+        }));
+    }
+
+    void reclaimer::flush() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _drained.wait(lock, [this]() { return _queue.empty() && _in_flight == 0; });
+    }
+
+    std::size_t reclaimer::queued_bytes() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _queued_bytes;
+    }
+
+    void reclaimer::run() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _has_garbage.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+            if (_queue.empty()) {
+                return;
+            }
+
+            std::deque<entry> batch;
+            batch.swap(_queue);
+            _in_flight = batch.size();
+            lock.unlock();
+
+            std::size_t released = 0;
+            for (auto& item : batch) {
+                item.first.reset();
+                released += item.second;
+            }
+            batch.clear();
+
+            lock.lock();
+            _queued_bytes -= released;
+            _in_flight = 0;
+            if (_queue.empty()) {
+                _drained.notify_all();
+            }
+        }
+    }
+}
@@ -2,16 +2,31 @@
 // Created by Anton Tcholakov on 2019-06-30.
 //
 
+#pragma once
+
+#include <algorithm>
+#include <exception>
 #include <utility>
 #include <iostream>
 #include <memory>
 #include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
 #include "immer/map.hpp"
+#include "immer/map_transient.hpp"
+#include "immer/vector.hpp"
+#include "immer/vector_transient.hpp"
 
 #include "atom.h"
 #include "lens.h"
+#include "schema.h"
 #include "tagged.h"
 
 namespace aeternum {
@@ -21,16 +36,32 @@ namespace aeternum {
 
     class untyped_record;
 
+    // Field names are literal types: declare them constexpr so that they are constant-initialised and
+    // records can describe their schema at compile time.
     template<typename T>
-    class field_name : public lens<tagged<untyped_record>, T> {
+    class field_name : public lens_ref<tagged<untyped_record>, T> {
     public:
         using type = T;
 
-        explicit field_name(const char *key_) noexcept;
+        explicit constexpr field_name(const char *key_) noexcept;
 
-        inline const atom key() const;
+        constexpr const atom key() const { return _field_key; }
 
     private:
+        using accessors = typename lens_ref<tagged<untyped_record>, T>::accessors;
+
+        static inline std::shared_ptr<const T> get_field(const void *context, const tagged<untyped_record> &record);
+
+        static inline tagged<untyped_record> set_field(const void *context, const tagged<untyped_record> &record,
+                                                       const std::shared_ptr<const T> &value);
+
+        static inline tagged<untyped_record> update_field(const void *context, tagged<untyped_record> &&record,
+                                                          const std::shared_ptr<const T> &value);
+
+        static inline std::vector<atom> field_path(const void *context);
+
+        static constexpr accessors field_accessors = { &get_field, &set_field, &update_field, &field_path, nullptr, nullptr };
+
         const atom _field_key;
     };
 
@@ -49,7 +80,9 @@ namespace aeternum {
         untyped_record& operator=(const untyped_record& other) = default;
         untyped_record& operator=(untyped_record&& other) = default;
 
-        data raw_data() const;
+        const data& raw_data() const;
+
+        inline untyped_record with_raw_data(data fields) const;
 
         std::size_t get_hash() const { return _hasher(*this); }
 
@@ -60,13 +93,24 @@ namespace aeternum {
         inline const T get(const field_name<T> &field_name) const;
 
         template<typename T>
-        inline untyped_record set(const field_name<T> &field_name, T &&value) const;
+        inline const T& get_ref(const field_name<T> &field_name) const;
+
+        template<typename T>
+        inline untyped_record set(const field_name<T> &field_name, T &&value) const &;
+
+        template<typename T>
+        inline untyped_record set(const field_name <T> &field_name, const std::shared_ptr<const T> &value) const &;
 
+        // Updates a record that will not be read again, letting immer modify the nodes it owns exclusively
+        // instead of copying them.
         template<typename T>
-        inline untyped_record set(const field_name <T> &field_name, const std::shared_ptr<const T> &value) const;
+        inline untyped_record set(const field_name<T> &field_name, T &&value) &&;
 
         template<typename T>
-        inline const T operator[](const field_name<T> &field_name) const;
+        inline untyped_record set(const field_name <T> &field_name, const std::shared_ptr<const T> &value) &&;
+
+        template<typename T>
+        inline const T& operator[](const field_name<T> &field_name) const;
 
     protected:
         data _data;
@@ -82,38 +126,21 @@ namespace aeternum {
     public:
         template<const field_name<TFieldTypes>& ...names>
         struct hasher {
-            std::size_t operator()(const untyped_record& record) {
-                return get_hash<sizeof...(TFieldTypes) - 1, names...>(record);
+            template<typename TRecord>
+            std::size_t operator()(const TRecord& record) const {
+                std::size_t seed = 0;
+                ((seed = std::hash<TFieldTypes>{}(record.get_ref(names)) ^ (seed << 1)), ...);
+                return seed;
             }
         };
 
         template<const field_name<TFieldTypes>& ...names>
         struct equality_comparer {
-            bool operator()(const untyped_record& lhs, const untyped_record& rhs) {
-                return equal_to<sizeof...(TFieldTypes) - 1, names...>(lhs, rhs);
+            template<typename TRecord>
+            bool operator()(const TRecord& lhs, const TRecord& rhs) const {
+                return (std::equal_to<TFieldTypes>{}(lhs.get_ref(names), rhs.get_ref(names)) && ...);
             }
         };
-
-    private:
-        template<std::size_t N, const field_name<TFieldTypes>& ...names>
-        static std::size_t get_hash(const untyped_record& record) {
-            return N > 0
-                   ? std::hash<typename std::tuple_element<std::greater<>{}(N, 0) ? N : 0, std::tuple<TFieldTypes...>>::type>{}(
-                            record.get(std::get<std::greater<>{}(N, 0) ? N : 0>(std::forward_as_tuple(names...))))
-                     ^ (record_utils<TFieldTypes...>::get_hash<std::greater<>{}(N, 0) ? N - 1 : 0, names...>(record) << 1)
-                   : std::hash<typename std::tuple_element<0, std::tuple<TFieldTypes...>>::type>{}(
-                            record.get(std::get<0>(std::forward_as_tuple(names...))));
-        }
-
-        template<std::size_t N, const field_name<TFieldTypes>& ...names>
-        static std::size_t equal_to(const untyped_record& lhs, const untyped_record& rhs) {
-            return N > 0
-                   ? std::equal_to<typename std::tuple_element<std::greater<>{}(N, 0) ? N : 0, std::tuple<TFieldTypes...>>::type>{}(
-                            lhs.get(std::get<std::greater<>{}(N, 0) ? N : 0>(std::forward_as_tuple(names...))), rhs.get(std::get<N>(std::forward_as_tuple(names...))))
-                     && (record_utils<TFieldTypes...>::equal_to<std::greater<>{}(N, 0) ? N - 1 : 0, names...>(lhs, rhs) << 1)
-                   : std::equal_to<typename std::tuple_element<0, std::tuple<TFieldTypes...>>::type>{}(
-                            lhs.get(std::get<0>(std::forward_as_tuple(names...))), rhs.get(std::get<0>(std::forward_as_tuple(names...))));
-        }
     };
 
     template<typename ...TFieldTypes>
@@ -122,47 +149,193 @@ namespace aeternum {
         template<const atom& tag, const field_name<TFieldTypes> &...names>
         class record : public untyped_record {
         public:
-            using tagged = tagged<record<tag, names...>>;
+            using tagged = aeternum::tagged<record>;
+            using field_types = std::tuple<TFieldTypes...>;
+            using schema_type = record_schema<TFieldTypes...>;
+
+            static constexpr const atom &record_tag = tag;
+
+            static constexpr schema_type schema{ tag, {{ names.key()... }} };
+
+            // The record's field values held by value in a tuple, with no field map and no type-erased hasher or
+            // comparer, for containers that store records inline. Fields are found through the record's schema,
+            // and it hashes and compares equal to the record it was made from.
+            class unboxed {
+            public:
+                using record_type = record;
+
+                explicit unboxed(const record &record) : _fields(record.get_ref(names)...) {}
+
+                template<typename T>
+                const T &get_ref(const field_name<T> &field_name) const {
+                    auto const result = find<T>(schema.index_of(field_name.key()), std::index_sequence_for<TFieldTypes...>{});
+                    if (!result) {
+                        throw std::out_of_range("record: no field " + std::string(field_name.key().name) + " of that type");
+                    }
+                    return *result;
+                }
+
+                template<typename T>
+                const T &operator[](const field_name<T> &field_name) const { return get_ref(field_name); }
+
+                std::size_t get_hash() const { return _hasher(*this); }
+
+                // Copies the values into a record, all sharing one allocation.
+                tagged to_tagged() const {
+                    return make_shared_fields(std::index_sequence_for<TFieldTypes...>{}, std::make_shared<std::tuple<TFieldTypes...>>(_fields));
+                }
+
+                friend bool operator==(const unboxed &lhs, const unboxed &rhs) { return _equality_comparer(lhs, rhs); }
+
+                friend bool operator!=(const unboxed &lhs, const unboxed &rhs) { return !(lhs == rhs); }
+
+            private:
+                template<typename T, std::size_t ...Is>
+                const T *find(std::size_t index, std::index_sequence<Is...>) const {
+                    const T *result = nullptr;
+                    ((index == Is && (result = field_at<T, Is>(), true)) || ...);
+                    return result;
+                }
+
+                template<typename T, std::size_t I>
+                const T *field_at() const {
+                    if constexpr (std::is_same<T, std::tuple_element_t<I, std::tuple<TFieldTypes...>>>::value) {
+                        return &std::get<I>(_fields);
+                    } else {
+                        return nullptr;
+                    }
+                }
+
+                std::tuple<TFieldTypes...> _fields;
+            };
 
             static tagged make(TFieldTypes &&...fields) {
                 return make_tagged(tag, record(std::forward<TFieldTypes>(fields)...));
             }
 
-            explicit record(TFieldTypes &&...fields);
+            template<typename ...TColumns, typename = std::enable_if_t<sizeof...(TColumns) == sizeof...(TFieldTypes)>>
+            static immer::vector<tagged> make_many(const TColumns &...columns) {
+                return make_many(1, columns...);
+            }
+
+            // Builds one record per row of the given columns, one column per field in declaration order.
+            // Each row's field values share a single allocation, and rows are split across the given number
+            // of threads.
+            template<typename ...TColumns, typename = std::enable_if_t<sizeof...(TColumns) == sizeof...(TFieldTypes)>>
+            static immer::vector<tagged> make_many(std::size_t threads, const TColumns &...columns) {
+                const std::size_t rows = std::min({ static_cast<std::size_t>(std::size(columns))... });
+                if (rows != std::max({ static_cast<std::size_t>(std::size(columns))... })) {
+                    throw std::invalid_argument("make_many: columns must have the same length");
+                }
+
+                threads = std::max<std::size_t>(1, std::min(threads, rows));
+                const std::size_t chunk_size = (rows + threads - 1) / threads;
+
+                std::vector<std::vector<tagged>> chunks(threads);
+                std::vector<std::exception_ptr> errors(threads);
+                auto build_chunk = [&](std::size_t chunk) {
+                    try {
+                        const std::size_t first = std::min(rows, chunk * chunk_size);
+                        const std::size_t last = std::min(rows, first + chunk_size);
+                        if (first == last) {
+                            return;
+                        }
+                        chunks[chunk].reserve(last - first);
+                        for (auto row = first; row < last; row++) {
+                            chunks[chunk].push_back(make_row(std::index_sequence_for<TFieldTypes...>{}, row, columns...));
+                        }
+                    } catch (...) {
+                        errors[chunk] = std::current_exception();
+                    }
+                };
+
+                std::vector<std::thread> workers;
+                for (std::size_t chunk = 1; chunk < threads; chunk++) {
+                    workers.emplace_back(build_chunk, chunk);
+                }
+                build_chunk(0);
+                for (auto& worker : workers) {
+                    worker.join();
+                }
+
+                auto result = immer::vector<tagged>().transient();
+                for (std::size_t chunk = 0; chunk < threads; chunk++) {
+                    if (errors[chunk]) {
+                        std::rethrow_exception(errors[chunk]);
+                    }
+                    for (auto& record : chunks[chunk]) {
+                        result.push_back(std::move(record));
+                    }
+                }
+                return result.persistent();
+            }
 
-            explicit record(const std::shared_ptr<TFieldTypes> &...fields);
+            explicit record(TFieldTypes &&...fields)
+                    : untyped_record(build(std::forward<TFieldTypes>(fields)...), _hasher, _equality_comparer) {}
 
-            explicit record(untyped_record &&base);
+            explicit record(const std::shared_ptr<TFieldTypes> &...fields)
+                    : untyped_record(build(fields...), _hasher, _equality_comparer) {}
+
+            explicit record(untyped_record &&base) : untyped_record(std::move(base)) {}
 
             record(const record &record) = default;
 
-            record(record &&record) noexcept : untyped_record(std::move(record.raw_data()), _hasher, _equality_comparer) {}
+            record(record &&record) noexcept : untyped_record(std::move(record._data), _hasher, _equality_comparer) {}
 
-        private:
-            class builder {
-            public:
-                inline data build(TFieldTypes &&...fields) const;
+            record &operator=(const record &other) = default;
+            record &operator=(record &&other) noexcept = default;
 
-                inline data build(const std::shared_ptr<TFieldTypes> &...fields) const;
+            template<typename TVisitor>
+            void for_each_field(TVisitor &&visitor) const {
+                (visitor(names, get_ref(names)), ...);
+            }
 
-            private:
-                template<size_t N, typename TField>
-                inline data build_inner(data &&data, TField &&field) const;
+            // Calls visitor(name, value) for the field with the given runtime name, which is found through the
+            // schema's perfect hash; returns false if the record has no such field.
+            template<typename TVisitor>
+            bool visit_field(std::string_view name, TVisitor &&visitor) const {
+                return visit_field_at(schema.index_of(name), std::index_sequence_for<TFieldTypes...>{}, visitor);
+            }
 
-                template<size_t N, typename TField>
-                inline data build_inner(data &&data, const std::shared_ptr<TField> &field) const;
+            template<typename TVisitor>
+            bool visit_field(const atom &name, TVisitor &&visitor) const {
+                return visit_field_at(schema.index_of(name), std::index_sequence_for<TFieldTypes...>{}, visitor);
+            }
 
-                template<size_t N, typename TField, typename ...TFields>
-                inline data build_inner(data &&data, TField &&field, TFields &&...fields) const;
+        private:
+            template<std::size_t ...Is, typename TVisitor>
+            bool visit_field_at(std::size_t index, std::index_sequence<Is...>, TVisitor &visitor) const {
+                return ((index == Is && (visitor(names, get_ref(names)), true)) || ...);
+            }
 
-                template<size_t N, typename TField, typename ...TFields>
-                inline data build_inner(data &&data, const std::shared_ptr<TField> &field,
-                                        const std::shared_ptr<TFields> &...fields) const;
-            };
+            template<std::size_t ...Is, typename ...TColumns>
+            static tagged make_row(std::index_sequence<Is...>, std::size_t row, const TColumns &...columns) {
+                return make_shared_fields(std::index_sequence<Is...>{},
+                                          std::make_shared<std::tuple<TFieldTypes...>>(TFieldTypes(columns[row])...));
+            }
 
-            static const typename record<tag, names...>::builder _builder;
-            static const typename record_utils<TFieldTypes...>::template hasher<names...> _hasher;
-            static const typename record_utils<TFieldTypes...>::template equality_comparer<names...> _equality_comparer;
+            // Builds a record whose field values all live in the given tuple, sharing its allocation.
+            template<std::size_t ...Is>
+            static tagged make_shared_fields(std::index_sequence<Is...>, const std::shared_ptr<std::tuple<TFieldTypes...>> &values) {
+                auto transient = data().transient();
+                (transient.set(names.key(), std::shared_ptr<void>(values, &std::get<Is>(*values))), ...);
+                return make_tagged(tag, record(untyped_record(transient.persistent(), _hasher, _equality_comparer)));
+            }
+
+            static data build(TFieldTypes &&...fields) {
+                auto transient = data().transient();
+                (transient.set(names.key(), std::make_shared<TFieldTypes>(std::forward<TFieldTypes>(fields))), ...);
+                return transient.persistent();
+            }
+
+            static data build(const std::shared_ptr<TFieldTypes> &...fields) {
+                auto transient = data().transient();
+                (transient.set(names.key(), fields), ...);
+                return transient.persistent();
+            }
+
+            static inline const typename record_utils<TFieldTypes...>::template hasher<names...> _hasher{};
+            static inline const typename record_utils<TFieldTypes...>::template equality_comparer<names...> _equality_comparer{};
         };
     };
 
@@ -170,35 +343,52 @@ namespace aeternum {
 //                        IMPLEMENTATION : LENS OPERATORS
 // --------------------------------------------------------------------------------------------
 
-    template<typename TA, typename TB, typename TC>
-    inline lens<TA, TC> operator>>(const lens<TA, TB> &left, const lens<tagged<untyped_record>, TC> &right) {
-        return lens<TA, TC>(
-                [=](const TA &record) { return right.get(*left.get(record)); },
-                [=](const TA &record, const std::shared_ptr<const TC> &value) {
-                    return left.set(record, TB(std::move(right.set(*left.get(record), value))));
-                });
-    }
-
     template<typename TRecord>
     inline TRecord operator|(const TRecord &record, const setter<tagged<untyped_record>> &setter) {
         return TRecord(setter.apply(static_cast<const tagged<untyped_record> &>(record)));
     }
 
+    // Pipelines on temporaries, such as all but the first step of a chain, update the record in place when
+    // no other handle shares it.
+    template<typename TRecord, typename = std::enable_if_t<!std::is_reference<TRecord>::value>>
+    inline TRecord operator|(TRecord &&record, const setter<tagged<untyped_record>> &setter) {
+        return TRecord(setter.apply(tagged<untyped_record>(std::move(record))));
+    }
+
 // --------------------------------------------------------------------------------------------
 //                           IMPLEMENTATION : FIELD NAME
 // --------------------------------------------------------------------------------------------
 
     template<typename T>
-    field_name<T>::field_name(const char *key_) noexcept
-            : _field_key(aeternum::atom(key_)),
-              lens<tagged<untyped_record>, T>(
-                      [&](const tagged<untyped_record> &record) { return (*record).get_ptr(*this); },
-                      [&](const tagged<untyped_record> &record, const std::shared_ptr<const T> &value) {
-                          return make_tagged(record.get_tag(), (*record).set(*this, value));
-                      }) {}
+    constexpr field_name<T>::field_name(const char *key_) noexcept
+            : lens_ref<tagged<untyped_record>, T>(this, field_accessors),
+              _field_key(aeternum::atom(key_)) {}
+
+    template<typename T>
+    std::shared_ptr<const T> field_name<T>::get_field(const void *context, const tagged<untyped_record> &record) {
+        return (*record).get_ptr(*static_cast<const field_name *>(context));
+    }
+
+    template<typename T>
+    tagged<untyped_record> field_name<T>::set_field(const void *context, const tagged<untyped_record> &record,
+                                                    const std::shared_ptr<const T> &value) {
+        return make_tagged(record.get_tag(), (*record).set(*static_cast<const field_name *>(context), value));
+    }
+
+    template<typename T>
+    tagged<untyped_record> field_name<T>::update_field(const void *context, tagged<untyped_record> &&record,
+                                                       const std::shared_ptr<const T> &value) {
+        if (!record.unique()) {
+            return set_field(context, record, value);
+        }
+        *record = std::move(*record).set(*static_cast<const field_name *>(context), value);
+        return std::move(record);
+    }
 
     template<typename T>
-    const atom field_name<T>::key() const { return _field_key; }
+    std::vector<atom> field_name<T>::field_path(const void *context) {
+        return { static_cast<const field_name *>(context)->key() };
+    }
 
 // --------------------------------------------------------------------------------------------
 //                           IMPLEMENTATION : RECORD
@@ -207,11 +397,20 @@ namespace aeternum {
     untyped_record::untyped_record(untyped_record::data &&data, untyped_record::hasher hasher, untyped_record::equality_comparer equality_comparer)
             : _data(std::move(data)), _hasher(std::move(hasher)), _equality_comparer(std::move(equality_comparer)) {}
 
-    untyped_record::data untyped_record::raw_data() const { return _data; }
+    const untyped_record::data& untyped_record::raw_data() const { return _data; }
+
+    untyped_record untyped_record::with_raw_data(untyped_record::data fields) const {
+        return untyped_record(std::move(fields), _hasher, _equality_comparer);
+    }
 
     template<typename T>
     const T untyped_record::get(const field_name <T> &field_name) const {
-        return *std::const_pointer_cast<const T>(std::static_pointer_cast<T>(_data[field_name.key()]));
+        return get_ref<T>(field_name);
+    }
+
+    template<typename T>
+    const T& untyped_record::get_ref(const field_name <T> &field_name) const {
+        return *static_cast<const T*>(_data[field_name.key()].get());
     }
 
     template<typename T>
@@ -221,102 +420,40 @@ namespace aeternum {
     }
 
     template<typename T>
-    untyped_record untyped_record::set(const field_name <T> &field_name, T &&value) const {
+    untyped_record untyped_record::set(const field_name <T> &field_name, T &&value) const & {
         return untyped_record(_data.set(field_name.key(), std::make_shared<T>(value)), _hasher, _equality_comparer);
     }
 
     template<typename T>
-    untyped_record untyped_record::set(const field_name <T> &field_name, const std::shared_ptr<const T> &value) const {
+    untyped_record untyped_record::set(const field_name <T> &field_name, const std::shared_ptr<const T> &value) const & {
         return untyped_record(
                 _data.set(field_name.key(), std::static_pointer_cast<void>(std::const_pointer_cast<T>(value))), _hasher, _equality_comparer);
     }
 
     template<typename T>
-    const T untyped_record::operator[](const field_name <T> &field_name) const {
-        return get<T>(field_name);
-    }
-
-    untyped_record::untyped_record(untyped_record &&base) noexcept : _data(std::move(base._data)) {}
-
-    bool operator==(const untyped_record &lhs, const untyped_record &rhs) {
-        return lhs._equality_comparer(lhs, rhs);
-    }
-
-    template<typename... TFieldTypes>
-    template<const atom& tag, const field_name<TFieldTypes> &... names>
-    template<size_t N, typename TField, typename... TFields>
-    untyped_record::data fields<TFieldTypes...>::record<tag, names...>::builder::build_inner(
-            untyped_record::data &&data, const std::shared_ptr<TField> &field,
-            const std::shared_ptr<TFields> &...fields) const {
-        return build_inner<N + 1>(data.set(std::get<N>(std::forward_as_tuple(names...)).key(), field), fields...);
+    untyped_record untyped_record::set(const field_name <T> &field_name, T &&value) && {
+        return untyped_record(std::move(_data).set(field_name.key(), std::make_shared<T>(std::forward<T>(value))),
+                              std::move(_hasher), std::move(_equality_comparer));
     }
 
-    template<typename... TFieldTypes>
-    template<const atom& tag, const field_name<TFieldTypes> &... names>
-    template<size_t N, typename TField, typename... TFields>
-    untyped_record::data fields<TFieldTypes...>::record<tag, names...>::builder::build_inner(
-            untyped_record::data &&data, TField &&field, TFields &&... fields) const {
-        return build_inner<N + 1>(
-                data.set(std::get<N>(std::forward_as_tuple(names...)).key(), std::make_shared<TField>(field)),
-                std::forward<TFields>(fields)...);
-    }
-
-    template<typename... TFieldTypes>
-    template<const atom& tag, const field_name<TFieldTypes> &... names>
-    template<size_t N, typename TField>
-    untyped_record::data fields<TFieldTypes...>::record<tag, names...>::builder::build_inner(
-            untyped_record::data &&data, const std::shared_ptr<TField> &field) const {
-        return data.set(std::get<N>(std::forward_as_tuple(names...)).key(), field);
+    template<typename T>
+    untyped_record untyped_record::set(const field_name <T> &field_name, const std::shared_ptr<const T> &value) && {
+        return untyped_record(
+                std::move(_data).set(field_name.key(), std::static_pointer_cast<void>(std::const_pointer_cast<T>(value))),
+                std::move(_hasher), std::move(_equality_comparer));
     }
 
-    template<typename... TFieldTypes>
-    template<const atom& tag, const field_name<TFieldTypes> &... names>
-    template<size_t N, typename TField>
-    untyped_record::data
-    fields<TFieldTypes...>::record<tag, names...>::builder::build_inner(untyped_record::data &&data, TField &&field) const {
-        return data.set(std::get<N>(std::forward_as_tuple(names...)).key(),
-                        std::make_shared<TField>(std::forward<TField>(field)));
+    template<typename T>
+    const T& untyped_record::operator[](const field_name <T> &field_name) const {
+        return get_ref<T>(field_name);
     }
 
-    template<typename... TFieldTypes>
-    template<const atom& tag, const field_name<TFieldTypes> &... names>
-    untyped_record::data
-    fields<TFieldTypes...>::record<tag, names...>::builder::build(const std::shared_ptr<TFieldTypes> &... fields) const {
-        return build_inner<0, TFieldTypes...>(data(), fields...);
-    }
+    untyped_record::untyped_record(untyped_record &&base) noexcept
+            : _data(std::move(base._data)), _hasher(std::move(base._hasher)), _equality_comparer(std::move(base._equality_comparer)) {}
 
-    template<typename... TFieldTypes>
-    template<const atom& tag, const field_name<TFieldTypes> &... names>
-    untyped_record::data fields<TFieldTypes...>::record<tag, names...>::builder::build(TFieldTypes &&... fields) const {
-        return build_inner<0, TFieldTypes...>(data(), std::forward<TFieldTypes>(fields)...);
+    bool operator==(const untyped_record &lhs, const untyped_record &rhs) {
+        return lhs._equality_comparer(lhs, rhs);
     }
-
-    template<typename... TFieldTypes>
-    template<const atom& tag, const field_name<TFieldTypes> &... names>
-    const typename fields<TFieldTypes...>::template record<tag, names...>::builder fields<TFieldTypes...>::record<tag, names...>::_builder =
-            fields<TFieldTypes...>::template record<tag, names...>::builder();
-
-    template<typename... TFieldTypes>
-    template<const atom& tag, const field_name<TFieldTypes> &... names>
-    const typename record_utils<TFieldTypes...>::template hasher<names...> fields<TFieldTypes...>::record<tag, names...>::_hasher;
-
-    template<typename... TFieldTypes>
-    template<const atom& tag, const field_name<TFieldTypes> &... names>
-    const typename record_utils<TFieldTypes...>::template equality_comparer<names...> fields<TFieldTypes...>::record<tag, names...>::_equality_comparer ;
-
-    template<typename... TFieldTypes>
-    template<const atom& tag, const field_name<TFieldTypes> &... names>
-    fields<TFieldTypes...>::record<tag, names...>::record(TFieldTypes &&... fields)
-            : untyped_record(_builder.build(std::forward<TFieldTypes>(fields)...), _hasher, _equality_comparer) {}
-
-    template<typename... TFieldTypes>
-    template<const atom& tag, const field_name<TFieldTypes> &... names>
-    fields<TFieldTypes...>::record<tag, names...>::record(const std::shared_ptr<TFieldTypes> &... fields)
-            : untyped_record(_builder.build(fields...), _hasher, _equality_comparer) {}
-
-    template<typename... TFieldTypes>
-    template<const atom& tag, const field_name<TFieldTypes> &... names>
-    fields<TFieldTypes...>::record<tag, names...>::record(untyped_record &&base) : untyped_record(std::move(base)) {}
 }
 
 namespace std {
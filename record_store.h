@@ -0,0 +1,438 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "immer/map.hpp"
+#include "immer/map_transient.hpp"
+
+#include "codec.h"
+#include "crc32.h"
+#include "tagged.h"
+
+namespace aeternum {
+
+    // A durable map of tagged records. Updates are appended to a log as CRC32-framed entries and made
+    // durable in groups: commit() writes everything pending with a single write and fsync, and threads
+    // committing concurrently share that flush. checkpoint() writes the whole map to a snapshot and
+    // empties the log. On open, the snapshot is loaded and the log replayed up to the first torn or
+    // corrupt entry, which is truncated away.
+    //
+    // Updates are numbered in the order they are made. The snapshot ends with the number of the last
+    // update it includes, and the log starts with the number of the update before its first entry, so
+    // entries a snapshot already covers are skipped even if a crash left them in the log.
+    //
+    // A commit that fails truncates the log back to its last durable length and keeps its entries pending,
+    // so that a later commit writes them again. If the log cannot be restored, the store fails: put, erase,
+    // commit and checkpoint throw from then on, and it must be reopened to recover what was made durable.
+    template<typename TKey, typename TRecord>
+    class record_store {
+    public:
+        using value_type = typename TRecord::tagged;
+        using map = immer::map<TKey, value_type>;
+
+        explicit record_store(std::filesystem::path directory);
+
+        record_store(const record_store &other) = delete;
+        record_store &operator=(const record_store &other) = delete;
+
+        ~record_store();
+
+        map snapshot() const;
+
+        std::uint64_t put(const TKey &key, const value_type &value);
+
+        std::uint64_t erase(const TKey &key);
+
+        void commit(std::uint64_t sequence);
+
+        void commit();
+
+        void checkpoint();
+
+    private:
+        enum class operation : std::uint8_t {
+            put = 1,
+            erase = 2,
+            sequence = 3
+        };
+
+        static void append_entry(std::string &out, operation op, const TKey &key, const value_type *value);
+
+        static void append_sequence(std::string &out, std::uint64_t sequence);
+
+        // Applies the entries numbered above after, numbering each from the last sequence entry before it,
+        // and returns the length of the valid prefix.
+        static std::size_t replay(const std::string &bytes, typename map::transient_type &data,
+                                  std::uint64_t after, std::uint64_t &sequence);
+
+        void restart_log(std::uint64_t sequence);
+
+        static std::string read_file(const std::filesystem::path &path);
+
+        static void write_all(int fd, const std::string &bytes);
+
+        static void sync(int fd);
+
+        static void sync_directory(const std::filesystem::path &directory);
+
+        std::uint64_t append(std::string &&entry);
+
+        void throw_if_failed() const;
+
+        const std::filesystem::path _directory;
+        int _log;
+        map _data;
+        std::string _pending;
+        std::uint64_t _appended;
+        std::uint64_t _durable;
+        std::size_t _log_size;
+        bool _flushing;
+        bool _failed;
+        mutable std::mutex _mutex;
+        std::condition_variable _flushed;
+    };
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : RECORD STORE
+// --------------------------------------------------------------------------------------------
+
+    template<typename TKey, typename TRecord>
+    record_store<TKey, TRecord>::record_store(std::filesystem::path directory)
+            : _directory(std::move(directory)), _log(-1), _appended(0), _durable(0), _log_size(0),
+              _flushing(false), _failed(false) {
+        std::filesystem::create_directories(_directory);
+        std::filesystem::remove(_directory / "snapshot.tmp");
+
+        auto data = map().transient();
+        std::uint64_t covered = 0;
+        if (std::filesystem::exists(_directory / "snapshot")) {
+            const auto snapshot = read_file(_directory / "snapshot");
+            if (replay(snapshot, data, 0, covered) != snapshot.size()) {
+                throw std::runtime_error("record_store: snapshot is corrupt");
+            }
+        }
+
+        const auto log = read_file(_directory / "log");
+        std::uint64_t sequence = covered;
+        const auto valid = replay(log, data, covered, sequence);
+        _data = data.persistent();
+
+        _log = ::open((_directory / "log").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (_log < 0) {
+            throw std::system_error(errno, std::generic_category(), "record_store: cannot open log");
+        }
+
+        // A log that is empty, or that ends before the snapshot because a checkpoint was interrupted before
+        // emptying it, is started again after the snapshot so that new entries are numbered correctly.
+        _appended = _durable = std::max(covered, sequence);
+        if (valid == 0 || sequence < covered) {
+            restart_log(_appended);
+        } else {
+            if (valid != log.size()) {
+                if (::ftruncate(_log, static_cast<off_t>(valid)) != 0) {
+                    throw std::system_error(errno, std::generic_category(), "record_store: cannot truncate log");
+                }
+                sync(_log);
+            }
+            _log_size = valid;
+        }
+    }
+
+    template<typename TKey, typename TRecord>
+    record_store<TKey, TRecord>::~record_store() {
+        try {
+            commit();
+        } catch (...) {
+        }
+        ::close(_log);
+    }
+
+    template<typename TKey, typename TRecord>
+    typename record_store<TKey, TRecord>::map record_store<TKey, TRecord>::snapshot() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _data;
+    }
+
+    template<typename TKey, typename TRecord>
+    std::uint64_t record_store<TKey, TRecord>::put(const TKey &key, const value_type &value) {
+        std::string entry;
+        append_entry(entry, operation::put, key, &value);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        throw_if_failed();
+        _data = _data.set(key, value);
+        return append(std::move(entry));
+    }
+
+    template<typename TKey, typename TRecord>
+    std::uint64_t record_store<TKey, TRecord>::erase(const TKey &key) {
+        std::string entry;
+        append_entry(entry, operation::erase, key, nullptr);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        throw_if_failed();
+        _data = _data.erase(key);
+        return append(std::move(entry));
+    }
+
+    template<typename TKey, typename TRecord>
+    void record_store<TKey, TRecord>::commit(std::uint64_t sequence) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_durable < sequence) {
+            throw_if_failed();
+            if (_flushing) {
+                _flushed.wait(lock);
+                continue;
+            }
+
+            _flushing = true;
+            std::string batch;
+            batch.swap(_pending);
+            const auto last = _appended;
+            lock.unlock();
+
+            try {
+                write_all(_log, batch);
+                sync(_log);
+            } catch (...) {
+                // A partial write leaves a torn entry that would hide everything appended after it.
+                const bool restored = ::ftruncate(_log, static_cast<off_t>(_log_size)) == 0;
+
+                lock.lock();
+                if (restored) {
+                    _pending.insert(0, batch);
+                } else {
+                    _failed = true;
+                }
+                _flushing = false;
+                _flushed.notify_all();
+                throw;
+            }
+
+            lock.lock();
+            _flushing = false;
+            _durable = last;
+            _log_size += batch.size();
+            _flushed.notify_all();
+        }
+    }
+
+    template<typename TKey, typename TRecord>
+    void record_store<TKey, TRecord>::commit() {
+        std::uint64_t sequence;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            sequence = _appended;
+        }
+        commit(sequence);
+    }
+
+    template<typename TKey, typename TRecord>
+    void record_store<TKey, TRecord>::checkpoint() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _flushed.wait(lock, [this]() { return !_flushing; });
+        throw_if_failed();
+
+        _flushing = true;
+        const auto data = _data;
+        const auto last = _appended;
+        std::string covered;
+        covered.swap(_pending);
+        lock.unlock();
+
+        bool replaced = false;
+        try {
+            std::string bytes;
+            for (auto& kvp : data) {
+                append_entry(bytes, operation::put, kvp.first, &kvp.second);
+            }
+            append_sequence(bytes, last);
+
+            const auto temporary = _directory / "snapshot.tmp";
+            const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                throw std::system_error(errno, std::generic_category(), "record_store: cannot create snapshot");
+            }
+            try {
+                write_all(fd, bytes);
+                sync(fd);
+            } catch (...) {
+                ::close(fd);
+                throw;
+            }
+            ::close(fd);
+
+            std::filesystem::rename(temporary, _directory / "snapshot");
+            replaced = true;
+            sync_directory(_directory);
+
+            restart_log(last);
+        } catch (...) {
+            // Once the snapshot is replaced, the log no longer matches the entries still in memory.
+            lock.lock();
+            if (replaced) {
+                _failed = true;
+            } else {
+                _pending.insert(0, covered);
+            }
+            _flushing = false;
+            _flushed.notify_all();
+            throw;
+        }
+
+        lock.lock();
+        _flushing = false;
+        _durable = std::max(_durable, last);
+        _flushed.notify_all();
+    }
+
+    template<typename TKey, typename TRecord>
+    void record_store<TKey, TRecord>::restart_log(std::uint64_t sequence) {
+        if (::ftruncate(_log, 0) != 0) {
+            throw std::system_error(errno, std::generic_category(), "record_store: cannot truncate log");
+        }
+
+        _log_size = 0;
+
+        std::string header;
+        append_sequence(header, sequence);
+        write_all(_log, header);
+        sync(_log);
+        _log_size = header.size();
+    }
+
+    template<typename TKey, typename TRecord>
+    std::uint64_t record_store<TKey, TRecord>::append(std::string &&entry) {
+        if (_pending.empty()) {
+            _pending = std::move(entry);
+        } else {
+            _pending.append(entry);
+        }
+        return ++_appended;
+    }
+
+    template<typename TKey, typename TRecord>
+    void record_store<TKey, TRecord>::throw_if_failed() const {
+        if (_failed) {
+            throw std::runtime_error("record_store: a failed write left the log inconsistent; reopen the store");
+        }
+    }
+
+    template<typename TKey, typename TRecord>
+    void record_store<TKey, TRecord>::append_entry(std::string &out, operation op, const TKey &key, const value_type *value) {
+        std::string payload;
+        codec<std::uint8_t>::write(payload, static_cast<std::uint8_t>(op));
+        codec<TKey>::write(payload, key);
+        if (value) {
+            codec<value_type>::write(payload, *value);
+        }
+
+        codec<std::uint32_t>::write(out, static_cast<std::uint32_t>(payload.size()));
+        codec<std::uint32_t>::write(out, crc32_buffer(payload.data(), payload.size()));
+        out.append(payload);
+    }
+
+    template<typename TKey, typename TRecord>
+    void record_store<TKey, TRecord>::append_sequence(std::string &out, std::uint64_t sequence) {
+        std::string payload;
+        codec<std::uint8_t>::write(payload, static_cast<std::uint8_t>(operation::sequence));
+        codec<std::uint64_t>::write(payload, sequence);
+
+        codec<std::uint32_t>::write(out, static_cast<std::uint32_t>(payload.size()));
+        codec<std::uint32_t>::write(out, crc32_buffer(payload.data(), payload.size()));
+        out.append(payload);
+    }
+
+    template<typename TKey, typename TRecord>
+    std::size_t record_store<TKey, TRecord>::replay(const std::string &bytes, typename map::transient_type &data,
+                                                    std::uint64_t after, std::uint64_t &sequence) {
+        constexpr std::size_t header_size = 2 * sizeof(std::uint32_t);
+
+        std::size_t position = 0;
+        while (bytes.size() - position >= header_size) {
+            codec_reader header(bytes.data() + position, bytes.data() + position + header_size);
+            const auto length = codec<std::uint32_t>::read(header);
+            const auto crc = codec<std::uint32_t>::read(header);
+            if (bytes.size() - position - header_size < length) {
+                break;
+            }
+
+            const char *payload = bytes.data() + position + header_size;
+            if (crc32_buffer(payload, length) != crc) {
+                break;
+            }
+
+            codec_reader in(payload, payload + length);
+            const auto op = static_cast<operation>(codec<std::uint8_t>::read(in));
+            if (op == operation::sequence) {
+                sequence = codec<std::uint64_t>::read(in);
+            } else if (++sequence > after) {
+                auto key = codec<TKey>::read(in);
+                if (op == operation::put) {
+                    data.set(std::move(key), codec<value_type>::read(in));
+                } else {
+                    data.erase(key);
+                }
+            }
+
+            position += header_size + length;
+        }
+
+        return position;
+    }
+
+    template<typename TKey, typename TRecord>
+    std::string record_store<TKey, TRecord>::read_file(const std::filesystem::path &path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    template<typename TKey, typename TRecord>
+    void record_store<TKey, TRecord>::write_all(int fd, const std::string &bytes) {
+        std::size_t written = 0;
+        while (written < bytes.size()) {
+            const auto result = ::write(fd, bytes.data() + written, bytes.size() - written);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "record_store: write failed");
+            }
+            written += static_cast<std::size_t>(result);
+        }
+    }
+
+    template<typename TKey, typename TRecord>
+    void record_store<TKey, TRecord>::sync(int fd) {
+        if (::fsync(fd) != 0) {
+            throw std::system_error(errno, std::generic_category(), "record_store: fsync failed");
+        }
+    }
+
+    template<typename TKey, typename TRecord>
+    void record_store<TKey, TRecord>::sync_directory(const std::filesystem::path &directory) {
+        const int fd = ::open(directory.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "record_store: cannot open directory");
+        }
+        const int result = ::fsync(fd);
+        ::close(fd);
+        if (result != 0) {
+            throw std::system_error(errno, std::generic_category(), "record_store: fsync failed");
+        }
+    }
+}
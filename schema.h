@@ -0,0 +1,137 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+
+#include "atom.h"
+#include "crc32.h"
+
+namespace aeternum {
+
+    // Maps N distinct hashes to their indices without collisions, by searching at compile time for a
+    // multiplier that sends each hash to its own slot of a sparse table.
+    template<std::size_t N>
+    class perfect_hash {
+    public:
+        explicit constexpr perfect_hash(const std::array<std::size_t, N> &hashes);
+
+        // The only index whose hash can equal the given one, or N when there is none.
+        constexpr std::size_t find(std::size_t hash) const { return _slots[slot(hash, _multiplier)]; }
+
+    private:
+        static constexpr std::size_t bits_for(std::size_t size) {
+            std::size_t bits = 1;
+            while ((std::size_t(1) << bits) < size) {
+                bits++;
+            }
+            return bits;
+        }
+
+        // A quarter full for small tables, growing with the square of N so that a multiplier is found quickly.
+        static constexpr std::size_t table_bits = bits_for(N * 4 > N * N / 8 ? N * 4 : N * N / 8);
+
+        static constexpr std::size_t slot(std::size_t hash, std::uint64_t multiplier) {
+            return static_cast<std::size_t>((static_cast<std::uint64_t>(hash) * multiplier) >> (64 - table_bits));
+        }
+
+        std::uint64_t _multiplier;
+        std::array<std::uint32_t, std::size_t(1) << table_bits> _slots;
+    };
+
+    // A compile-time description of a record type: its tag and, in declaration order, the name, atom hash
+    // and type of each field. Lookup by name goes through a perfect hash of the field atoms, costing one
+    // hash of the name, one table load and one string comparison.
+    template<typename ...TFieldTypes>
+    class record_schema {
+    public:
+        using field_types = std::tuple<TFieldTypes...>;
+
+        template<std::size_t I>
+        using field_type = std::tuple_element_t<I, field_types>;
+
+        static constexpr std::size_t field_count = sizeof...(TFieldTypes);
+        static constexpr std::size_t npos = field_count;
+
+        constexpr record_schema(const atom &tag, const std::array<atom, field_count> &names)
+                : _tag(tag), _names(names), _index(hashes_of(names)) {}
+
+        constexpr const atom &get_tag() const { return _tag; }
+
+        constexpr const std::array<atom, field_count> &names() const { return _names; }
+
+        inline constexpr std::size_t index_of(const atom &name) const;
+
+        inline constexpr std::size_t index_of(std::string_view name) const;
+
+    private:
+        static inline constexpr std::array<std::size_t, field_count> hashes_of(const std::array<atom, field_count> &names);
+
+        const atom _tag;
+        const std::array<atom, field_count> _names;
+        const perfect_hash<field_count> _index;
+    };
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : PERFECT HASH
+// --------------------------------------------------------------------------------------------
+
+    template<std::size_t N>
+    constexpr perfect_hash<N>::perfect_hash(const std::array<std::size_t, N> &hashes) : _multiplier(0), _slots{} {
+        for (auto& entry : _slots) {
+            entry = N;
+        }
+
+        for (std::uint64_t attempt = 0; attempt < 4096; attempt++) {
+            _multiplier = 0x9E3779B97F4A7C15ull * (2 * attempt + 1);
+
+            std::size_t placed = 0;
+            while (placed < N && _slots[slot(hashes[placed], _multiplier)] == N) {
+                _slots[slot(hashes[placed], _multiplier)] = static_cast<std::uint32_t>(placed);
+                placed++;
+            }
+            if (placed == N) {
+                return;
+            }
+
+            for (std::size_t i = 0; i < placed; i++) {
+                _slots[slot(hashes[i], _multiplier)] = N;
+            }
+        }
+
+        // Equal hashes, such as a field name declared twice, collide under every multiplier.
+        throw std::logic_error("perfect_hash: no collision-free multiplier found");
+    }
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : RECORD SCHEMA
+// --------------------------------------------------------------------------------------------
+
+    template<typename ...TFieldTypes>
+    constexpr std::size_t record_schema<TFieldTypes...>::index_of(const atom &name) const {
+        auto const index = _index.find(name.hash);
+        return index < field_count
+               && _names[index].hash == name.hash
+               && std::string_view(_names[index].name) == std::string_view(name.name)
+               ? index : npos;
+    }
+
+    template<typename ...TFieldTypes>
+    constexpr std::size_t record_schema<TFieldTypes...>::index_of(std::string_view name) const {
+        auto const index = _index.find(crc32_buffer(name.data(), name.size()));
+        return index < field_count && std::string_view(_names[index].name) == name ? index : npos;
+    }
+
+    template<typename ...TFieldTypes>
+    constexpr std::array<std::size_t, record_schema<TFieldTypes...>::field_count> record_schema<TFieldTypes...>::hashes_of(
+            const std::array<atom, field_count> &names) {
+        std::array<std::size_t, field_count> hashes{};
+        for (std::size_t i = 0; i < field_count; i++) {
+            hashes[i] = names[i].hash;
+        }
+        return hashes;
+    }
+}
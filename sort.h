@@ -0,0 +1,342 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "immer/vector.hpp"
+#include "immer/vector_transient.hpp"
+
+#include "query.h"
+
+namespace aeternum {
+
+    enum class sort_order {
+        ascending,
+        descending
+    };
+
+    // Stable sort of tagged records by a field or composed lens, producing a new vector. Keys are read
+    // once into a compact array. Integer and floating point keys of up to 64 bits are then ordered with a
+    // parallel LSD radix sort that skips bytes all keys share, string keys with a parallel MSD radix sort,
+    // and any other key type, wider ones such as long double included, with a parallel merge sort using
+    // std::less.
+    template<typename TValue, typename TKey>
+    immer::vector<TValue> sort_by(const immer::vector<TValue> &items, const key_lens<TKey> &key,
+                                  sort_order order = sort_order::ascending,
+                                  std::size_t threads = std::thread::hardware_concurrency());
+
+    // Computes the sorted permutation of a collection for a key type. Specialise to change how a key type
+    // is sorted.
+    template<typename TKey, typename = void>
+    struct sort_keys {
+        template<typename TValue>
+        static std::vector<std::uint32_t> permutation(const std::vector<const TValue *> &items, const key_lens<TKey> &key,
+                                                      sort_order order, std::size_t threads);
+    };
+
+    template<typename TKey>
+    struct sort_keys<TKey, std::enable_if_t<std::is_arithmetic<TKey>::value && sizeof(TKey) <= sizeof(std::uint64_t)>> {
+        template<typename TValue>
+        static std::vector<std::uint32_t> permutation(const std::vector<const TValue *> &items, const key_lens<TKey> &key,
+                                                      sort_order order, std::size_t threads);
+
+    private:
+        static inline std::uint64_t encode(TKey value, sort_order order);
+    };
+
+    template<typename TKey>
+    struct sort_keys<TKey, std::enable_if_t<std::is_convertible<const TKey &, std::string_view>::value>> {
+        template<typename TValue>
+        static std::vector<std::uint32_t> permutation(const std::vector<const TValue *> &items, const key_lens<TKey> &key,
+                                                      sort_order order, std::size_t threads);
+    };
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : SORT
+// --------------------------------------------------------------------------------------------
+
+    template<typename TFunction>
+    void for_each_slice(std::size_t count, std::size_t threads, TFunction &&function) {
+        const std::size_t chunk_size = (count + threads - 1) / threads;
+        run_parallel(threads, [&](std::size_t thread) {
+            const std::size_t first = std::min(count, thread * chunk_size);
+            function(thread, first, std::min(count, first + chunk_size));
+        });
+    }
+
+    // One stable counting-sort pass over input into output, with each thread counting and scattering its
+    // own slice. Returns the first offset of every bucket.
+    template<std::size_t Buckets, typename T, typename TBucket>
+    std::array<std::size_t, Buckets + 1> counting_pass(const std::vector<T> &input, std::vector<T> &output,
+                                                       std::size_t threads, TBucket &&bucket) {
+        std::vector<std::array<std::size_t, Buckets>> offsets(threads);
+        for_each_slice(input.size(), threads, [&](std::size_t thread, std::size_t first, std::size_t last) {
+            offsets[thread].fill(0);
+            for (auto i = first; i < last; i++) {
+                offsets[thread][bucket(input[i])]++;
+            }
+        });
+
+        std::array<std::size_t, Buckets + 1> starts{};
+        std::size_t position = 0;
+        for (std::size_t digit = 0; digit < Buckets; digit++) {
+            starts[digit] = position;
+            for (auto& thread_offsets : offsets) {
+                const auto count = thread_offsets[digit];
+                thread_offsets[digit] = position;
+                position += count;
+            }
+        }
+        starts[Buckets] = position;
+
+        for_each_slice(input.size(), threads, [&](std::size_t thread, std::size_t first, std::size_t last) {
+            for (auto i = first; i < last; i++) {
+                output[offsets[thread][bucket(input[i])]++] = input[i];
+            }
+        });
+        return starts;
+    }
+
+    template<typename TKey>
+    std::shared_ptr<const TKey> sort_key_of(const key_lens<TKey> &key, const tagged<untyped_record> &record) {
+        auto value = key.get(record);
+        if (!value) {
+            throw std::invalid_argument("sort_by: record has no value for the sort key");
+        }
+        return value;
+    }
+
+    template<typename TKey, typename TEnable>
+    template<typename TValue>
+    std::vector<std::uint32_t> sort_keys<TKey, TEnable>::permutation(const std::vector<const TValue *> &items, const key_lens<TKey> &key,
+                                                                     sort_order order, std::size_t threads) {
+        std::vector<std::shared_ptr<const TKey>> keys(items.size());
+        std::vector<std::uint32_t> result(items.size()), buffer(items.size());
+        for_each_slice(items.size(), threads, [&](std::size_t, std::size_t first, std::size_t last) {
+            for (auto i = first; i < last; i++) {
+                keys[i] = sort_key_of(key, as_untyped(*items[i]));
+                result[i] = static_cast<std::uint32_t>(i);
+            }
+        });
+
+        auto const less = [&](std::uint32_t lhs, std::uint32_t rhs) {
+            return order == sort_order::ascending
+                   ? std::less<TKey>{}(*keys[lhs], *keys[rhs])
+                   : std::less<TKey>{}(*keys[rhs], *keys[lhs]);
+        };
+
+        const std::size_t chunk_size = (items.size() + threads - 1) / threads;
+        std::vector<std::size_t> runs;
+        for (std::size_t first = 0; first < items.size(); first += chunk_size) {
+            runs.push_back(first);
+        }
+        runs.push_back(items.size());
+
+        run_parallel(runs.size() - 1, [&](std::size_t run) {
+            std::stable_sort(result.begin() + runs[run], result.begin() + runs[run + 1], less);
+        });
+
+        while (runs.size() > 2) {
+            std::vector<std::size_t> merged;
+            const std::size_t pairs = (runs.size() - 1) / 2;
+            run_parallel(pairs, [&](std::size_t pair) {
+                auto const first = result.begin() + runs[2 * pair];
+                auto const middle = result.begin() + runs[2 * pair + 1];
+                auto const last = result.begin() + runs[2 * pair + 2];
+                std::merge(first, middle, middle, last, buffer.begin() + runs[2 * pair], less);
+            });
+            for (std::size_t run = 0; run + 1 < runs.size(); run += 2) {
+                merged.push_back(runs[run]);
+            }
+            if ((runs.size() - 1) % 2 == 1) {
+                std::copy(result.begin() + runs[runs.size() - 2], result.end(), buffer.begin() + runs[runs.size() - 2]);
+            }
+            merged.push_back(items.size());
+
+            result.swap(buffer);
+            runs.swap(merged);
+        }
+
+        return result;
+    }
+
+    template<typename TKey>
+    std::uint64_t sort_keys<TKey, std::enable_if_t<std::is_arithmetic<TKey>::value && sizeof(TKey) <= sizeof(std::uint64_t)>>::encode(TKey value, sort_order order) {
+        constexpr std::uint64_t sign = std::uint64_t(1) << 63;
+
+        std::uint64_t bits;
+        if constexpr (std::is_floating_point<TKey>::value) {
+            const double widened = value;
+            std::memcpy(&bits, &widened, sizeof(bits));
+            bits = (bits & sign) ? ~bits : bits | sign;
+        } else if constexpr (std::is_signed<TKey>::value) {
+            bits = static_cast<std::uint64_t>(static_cast<std::int64_t>(value)) ^ sign;
+        } else {
+            bits = static_cast<std::uint64_t>(value);
+        }
+
+        return order == sort_order::ascending ? bits : ~bits;
+    }
+
+    template<typename TKey>
+    template<typename TValue>
+    std::vector<std::uint32_t> sort_keys<TKey, std::enable_if_t<std::is_arithmetic<TKey>::value && sizeof(TKey) <= sizeof(std::uint64_t)>>::permutation(
+            const std::vector<const TValue *> &items, const key_lens<TKey> &key, sort_order order, std::size_t threads) {
+        struct entry {
+            std::uint64_t key;
+            std::uint32_t index;
+        };
+
+        std::vector<entry> entries(items.size()), buffer(items.size());
+        std::vector<std::uint64_t> varying(threads, 0);
+        for_each_slice(items.size(), threads, [&](std::size_t, std::size_t first, std::size_t last) {
+            for (auto i = first; i < last; i++) {
+                entries[i] = { encode(*sort_key_of(key, as_untyped(*items[i])), order), static_cast<std::uint32_t>(i) };
+            }
+        });
+        for_each_slice(items.size(), threads, [&](std::size_t thread, std::size_t first, std::size_t last) {
+            for (auto i = first; i < last; i++) {
+                varying[thread] |= entries[i].key ^ entries[0].key;
+            }
+        });
+
+        std::uint64_t mask = 0;
+        for (auto bits : varying) {
+            mask |= bits;
+        }
+
+        for (unsigned shift = 0; shift < 64; shift += 8) {
+            if (((mask >> shift) & 0xff) == 0) {
+                continue;
+            }
+            counting_pass<256>(entries, buffer, threads, [shift](const entry &value) {
+                return static_cast<std::size_t>((value.key >> shift) & 0xff);
+            });
+            entries.swap(buffer);
+        }
+
+        std::vector<std::uint32_t> result(items.size());
+        for_each_slice(items.size(), threads, [&](std::size_t, std::size_t first, std::size_t last) {
+            for (auto i = first; i < last; i++) {
+                result[i] = entries[i].index;
+            }
+        });
+        return result;
+    }
+
+    // Sorts indices that already share their first depth characters, one character at a time. Bucket 0
+    // holds strings that have ended, which sort first when ascending and last when descending.
+    inline void string_radix_sort(std::uint32_t *first, std::uint32_t *last, std::uint32_t *buffer,
+                                  const std::vector<std::string_view> &keys, std::size_t depth, sort_order order) {
+        constexpr std::size_t small = 32;
+
+        auto const bucket = [&](std::uint32_t index) -> std::size_t {
+            auto const& key = keys[index];
+            if (key.size() <= depth) {
+                return order == sort_order::ascending ? 0 : 256;
+            }
+            auto const character = static_cast<unsigned char>(key[depth]);
+            return order == sort_order::ascending ? character + 1 : 255 - character;
+        };
+
+        if (static_cast<std::size_t>(last - first) <= small) {
+            std::stable_sort(first, last, [&](std::uint32_t lhs, std::uint32_t rhs) {
+                auto const left = keys[lhs].substr(std::min(depth, keys[lhs].size()));
+                auto const right = keys[rhs].substr(std::min(depth, keys[rhs].size()));
+                return order == sort_order::ascending ? left < right : right < left;
+            });
+            return;
+        }
+
+        std::array<std::size_t, 258> starts{};
+        for (auto it = first; it != last; ++it) {
+            starts[bucket(*it) + 1]++;
+        }
+        for (std::size_t digit = 1; digit < starts.size(); digit++) {
+            starts[digit] += starts[digit - 1];
+        }
+
+        auto positions = starts;
+        for (auto it = first; it != last; ++it) {
+            buffer[positions[bucket(*it)]++] = *it;
+        }
+        std::copy(buffer, buffer + (last - first), first);
+
+        const std::size_t ended = order == sort_order::ascending ? 0 : 256;
+        for (std::size_t digit = 0; digit < 257; digit++) {
+            if (digit != ended && starts[digit + 1] - starts[digit] > 1) {
+                string_radix_sort(first + starts[digit], first + starts[digit + 1], buffer, keys, depth + 1, order);
+            }
+        }
+    }
+
+    template<typename TKey>
+    template<typename TValue>
+    std::vector<std::uint32_t> sort_keys<TKey, std::enable_if_t<std::is_convertible<const TKey &, std::string_view>::value>>::permutation(
+            const std::vector<const TValue *> &items, const key_lens<TKey> &key, sort_order order, std::size_t threads) {
+        std::vector<std::shared_ptr<const TKey>> holders(items.size());
+        std::vector<std::string_view> keys(items.size());
+        std::vector<std::uint32_t> indices(items.size()), result(items.size());
+        for_each_slice(items.size(), threads, [&](std::size_t, std::size_t first, std::size_t last) {
+            for (auto i = first; i < last; i++) {
+                holders[i] = sort_key_of(key, as_untyped(*items[i]));
+                keys[i] = *holders[i];
+                indices[i] = static_cast<std::uint32_t>(i);
+            }
+        });
+
+        const std::size_t ended = order == sort_order::ascending ? 0 : 256;
+        auto const starts = counting_pass<257>(indices, result, threads, [&](std::uint32_t index) -> std::size_t {
+            if (keys[index].empty()) {
+                return ended;
+            }
+            auto const character = static_cast<unsigned char>(keys[index][0]);
+            return order == sort_order::ascending ? character + 1 : 255 - character;
+        });
+
+        std::atomic<std::size_t> next{ 0 };
+        run_parallel(threads, [&](std::size_t) {
+            for (auto digit = next++; digit < 257; digit = next++) {
+                if (digit != ended && starts[digit + 1] - starts[digit] > 1) {
+                    string_radix_sort(result.data() + starts[digit], result.data() + starts[digit + 1],
+                                      indices.data() + starts[digit], keys, 1, order);
+                }
+            }
+        });
+        return result;
+    }
+
+    template<typename TValue, typename TKey>
+    immer::vector<TValue> sort_by(const immer::vector<TValue> &items, const key_lens<TKey> &key, sort_order order,
+                                  std::size_t threads) {
+        if (items.size() > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::length_error("sort_by: too many records");
+        }
+
+        if (items.size() < 2) {
+            return items;
+        }
+
+        auto const values = gather(items);
+        threads = std::max<std::size_t>(1, std::min(threads, values.size()));
+        auto const permutation = sort_keys<TKey>::permutation(values, key, order, threads);
+
+        auto result = immer::vector<TValue>().transient();
+        for (auto index : permutation) {
+            result.push_back(*values[index]);
+        }
+        return result.persistent();
+    }
+}
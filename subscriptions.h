@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "atom.h"
+#include "lens.h"
+#include "record.h"
+#include "tagged.h"
+
+namespace aeternum {
+
+    // Change notifications keyed by lens paths. Subscriptions form a trie over field keys; publishing a
+    // new version walks the trie alongside both versions and stops wherever the two share the same field
+    // storage, so the cost follows the changed part of the subscribed paths rather than their number.
+    class subscriptions {
+    public:
+        using subscription_id = std::size_t;
+
+        template<typename TField, typename TCallback>
+        subscription_id subscribe(const lens_ref<tagged<untyped_record>, TField> &path, TCallback callback);
+
+        inline void unsubscribe(subscription_id id);
+
+        inline void publish(const tagged<untyped_record> &old_root, const tagged<untyped_record> &new_root) const;
+
+    private:
+        struct subscriber {
+            subscription_id id;
+            std::function<bool(const void *, const void *)> equals;
+            std::function<void(const void *, const void *)> notify;
+        };
+
+        // Nodes with children also keep the lens_step from their field's value to the nested record, taken
+        // from the lens that subscribed below them.
+        struct node {
+            std::vector<subscriber> subscribers;
+            std::unordered_map<atom, std::unique_ptr<node>> children;
+            lens_step record_of = nullptr;
+        };
+
+        inline void publish_fields(const node &node, const untyped_record::data *old_fields, const untyped_record::data *new_fields) const;
+
+        inline void publish_value(const node &node, const void *old_value, const void *new_value) const;
+
+        static inline const void *find(const untyped_record::data *fields, const atom &key);
+
+        static inline const untyped_record::data *fields_of(const node &node, const void *value);
+
+        node _root;
+        subscription_id _next_id = 0;
+        std::unordered_map<subscription_id, std::vector<atom>> _paths;
+    };
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : SUBSCRIPTIONS
+// --------------------------------------------------------------------------------------------
+
+    template<typename TField, typename TCallback>
+    subscriptions::subscription_id subscriptions::subscribe(const lens_ref<tagged<untyped_record>, TField> &path, TCallback callback) {
+        auto const keys = path.path();
+        if (keys.empty()) {
+            throw std::invalid_argument("subscriptions: lens has no field path");
+        }
+
+        auto const steps = path.steps();
+        if (steps.size() + 1 != keys.size() || std::count(steps.begin(), steps.end(), nullptr) > 0) {
+            throw std::invalid_argument("subscriptions: lens does not read through nested records");
+        }
+
+        node *current = &_root;
+        for (std::size_t depth = 0; depth < keys.size(); depth++) {
+            if (depth > 0) {
+                current->record_of = steps[depth - 1];
+            }
+
+            auto& child = current->children[keys[depth]];
+            if (!child) {
+                child = std::make_unique<node>();
+            }
+            current = child.get();
+        }
+
+        const auto id = _next_id++;
+        current->subscribers.push_back({
+            id,
+            [](const void *lhs, const void *rhs) {
+                return std::equal_to<TField>{}(*static_cast<const TField *>(lhs), *static_cast<const TField *>(rhs));
+            },
+            [callback](const void *old_value, const void *new_value) {
+                callback(static_cast<const TField *>(old_value), static_cast<const TField *>(new_value));
+            }
+        });
+        _paths.emplace(id, keys);
+        return id;
+    }
+
+    void subscriptions::unsubscribe(subscription_id id) {
+        auto const path = _paths.find(id);
+        if (path == _paths.end()) {
+            return;
+        }
+
+        std::vector<node *> trail { &_root };
+        for (auto& key : path->second) {
+            trail.push_back(trail.back()->children.at(key).get());
+        }
+
+        auto& subscribers = trail.back()->subscribers;
+        for (auto it = subscribers.begin(); it != subscribers.end(); ++it) {
+            if (it->id == id) {
+                subscribers.erase(it);
+                break;
+            }
+        }
+
+        for (auto depth = path->second.size(); depth > 0; depth--) {
+            auto const current = trail[depth];
+            if (!current->subscribers.empty() || !current->children.empty()) {
+                break;
+            }
+            trail[depth - 1]->children.erase(path->second[depth - 1]);
+        }
+
+        _paths.erase(path);
+    }
+
+    void subscriptions::publish(const tagged<untyped_record> &old_root, const tagged<untyped_record> &new_root) const {
+        publish_fields(_root,
+                       old_root ? &old_root->raw_data() : nullptr,
+                       new_root ? &new_root->raw_data() : nullptr);
+    }
+
+    void subscriptions::publish_fields(const node &node, const untyped_record::data *old_fields, const untyped_record::data *new_fields) const {
+        if (old_fields == new_fields
+            || (old_fields && new_fields && old_fields->identity() == new_fields->identity())) {
+            return;
+        }
+
+        for (auto& child : node.children) {
+            publish_value(*child.second, find(old_fields, child.first), find(new_fields, child.first));
+        }
+    }
+
+    void subscriptions::publish_value(const node &node, const void *old_value, const void *new_value) const {
+        if (old_value == new_value) {
+            return;
+        }
+
+        for (auto& subscriber : node.subscribers) {
+            if (!old_value || !new_value || !subscriber.equals(old_value, new_value)) {
+                subscriber.notify(old_value, new_value);
+            }
+        }
+
+        if (!node.children.empty()) {
+            publish_fields(node, fields_of(node, old_value), fields_of(node, new_value));
+        }
+    }
+
+    const void *subscriptions::find(const untyped_record::data *fields, const atom &key) {
+        if (!fields) {
+            return nullptr;
+        }
+
+        auto const value = fields->find(key);
+        return value ? value->get() : nullptr;
+    }
+
+    const untyped_record::data *subscriptions::fields_of(const node &node, const void *value) {
+        if (!value) {
+            return nullptr;
+        }
+
+        auto const record = static_cast<const untyped_record *>(node.record_of(value));
+        return record ? &record->raw_data() : nullptr;
+    }
+}
@@ -36,6 +36,9 @@ namespace aeternum {
 
         operator bool() const { return _data != nullptr; }
 
+        // Whether this is the only handle to the value, so that it can be updated in place.
+        bool unique() const { return _data.use_count() == 1; }
+
         std::size_t get_hash() const;
 
         bool operator==(const tagged_untyped& rhs) const {
@@ -72,10 +75,13 @@ namespace aeternum {
         T* operator->() const;
 
         template<typename U>
-        operator tagged<U>() const { return tagged<U>(_tag, std::static_pointer_cast<U>(_data)); }
+        operator tagged<U>() const & { return tagged<U>(_tag, std::static_pointer_cast<U>(_data)); }
+
+        template<typename U>
+        inline operator tagged<U>() &&;
 
         template<typename Idx>
-        const typename Idx::result_type operator[](const Idx& idx) const {
+        const typename Idx::result_type& operator[](const Idx& idx) const {
             return (*this)->operator[](idx);
         }
     };
@@ -96,14 +102,22 @@ namespace aeternum {
     template<typename T>
     tagged<T>::tagged(atom tag, std::shared_ptr<T> data) : tagged_untyped(tag, data) { }
 
+    template<typename T>
+    template<typename U>
+    tagged<T>::operator tagged<U>() && {
+        auto data = std::static_pointer_cast<U>(_data);
+        _data.reset();
+        return tagged<U>(_tag, std::move(data));
+    }
+
     template<typename T>
     T& tagged<T>::operator*() const {
-        return *(std::static_pointer_cast<T>(_data));
+        return *static_cast<T*>(_data.get());
     }
 
     template<typename T>
     T* tagged<T>::operator->() const {
-        return std::static_pointer_cast<T>(_data).operator->();
+        return static_cast<T*>(_data.get());
     }
 
     template<typename T>
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "atom.h"
+#include "record.h"
+#include "tagged.h"
+
+namespace aeternum {
+
+    // A closed sum of record types. The active alternative's field values are stored inline as the
+    // record's unboxed tuple, and visit() dispatches on its index rather than comparing tags, so a
+    // std::vector of unions is contiguous and field reads do not leave it. Hashing and equality go
+    // straight to each record's static hasher and comparer. Converts to and from tagged_untyped at API
+    // boundaries, copying the field values into a heap record only in to_tagged().
+    template<typename ...TRecords>
+    class tagged_union {
+    public:
+        using alternatives = std::variant<typename TRecords::unboxed...>;
+
+        template<typename TRecord, typename = std::enable_if_t<(std::is_same<TRecord, TRecords>::value || ...)>>
+        tagged_union(const TRecord &record) : _value(std::in_place_type<typename TRecord::unboxed>, record) {}
+
+        template<typename TRecord, typename = std::enable_if_t<(std::is_same<TRecord, TRecords>::value || ...)>>
+        tagged_union(const tagged<TRecord> &record) : tagged_union(*record) {}
+
+        explicit tagged_union(const tagged_untyped &value) : _value(unwrap(value)) {}
+
+        tagged_union(const tagged_union &other) = default;
+        tagged_union(tagged_union &&other) noexcept = default;
+
+        tagged_union &operator=(const tagged_union &other) = default;
+        tagged_union &operator=(tagged_union &&other) noexcept = default;
+
+        std::size_t index() const { return _value.index(); }
+
+        inline const atom get_tag() const;
+
+        template<typename TRecord>
+        const typename TRecord::unboxed *get_if() const { return std::get_if<typename TRecord::unboxed>(&_value); }
+
+        template<typename TVisitor>
+        decltype(auto) visit(TVisitor &&visitor) const {
+            return std::visit(std::forward<TVisitor>(visitor), _value);
+        }
+
+        inline tagged<untyped_record> to_tagged() const;
+
+        inline std::size_t get_hash() const;
+
+        bool operator==(const tagged_union &rhs) const { return _value == rhs._value; }
+
+        bool operator!=(const tagged_union &rhs) const { return !(*this == rhs); }
+
+    private:
+        static inline alternatives unwrap(const tagged_untyped &value);
+
+        alternatives _value;
+    };
+
+// --------------------------------------------------------------------------------------------
+//                           IMPLEMENTATION : TAGGED UNION
+// --------------------------------------------------------------------------------------------
+
+    template<typename ...TRecords>
+    const atom tagged_union<TRecords...>::get_tag() const {
+        return visit([](const auto &record) { return std::decay_t<decltype(record)>::record_type::record_tag; });
+    }
+
+    template<typename ...TRecords>
+    tagged<untyped_record> tagged_union<TRecords...>::to_tagged() const {
+        return visit([](const auto &record) -> tagged<untyped_record> { return record.to_tagged(); });
+    }
+
+    template<typename ...TRecords>
+    std::size_t tagged_union<TRecords...>::get_hash() const {
+        std::size_t h1 = std::hash<atom>{}(get_tag());
+        std::size_t h2 = visit([](const auto &record) { return record.get_hash(); });
+        return h1 ^ (h2 << 1);
+    }
+
+    template<typename ...TRecords>
+    typename tagged_union<TRecords...>::alternatives tagged_union<TRecords...>::unwrap(const tagged_untyped &value) {
+        std::optional<alternatives> result;
+        ((value && value.get_tag() == TRecords::record_tag
+          && (result.emplace(std::in_place_type<typename TRecords::unboxed>, *value.match<TRecords::record_tag, TRecords>()), true)) || ...);
+
+        if (!result) {
+            throw std::invalid_argument("tagged_union: value is not one of the alternatives");
+        }
+        return std::move(*result);
+    }
+}
+
+namespace std {
+    template<typename ...TRecords>
+    struct hash<aeternum::tagged_union<TRecords...>>
+    {
+        typedef aeternum::tagged_union<TRecords...> argument_type;
+        typedef std::size_t result_type;
+
+        result_type operator()(const argument_type& value) const noexcept
+        {
+            return value.get_hash();
+        }
+    };
+}
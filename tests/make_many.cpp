@@ -0,0 +1,77 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "atom.h"
+#include "record.h"
+
+namespace row {
+    constexpr aeternum::atom tag("row");
+
+    constexpr aeternum::field_name<std::string> name_("name");
+    constexpr aeternum::field_name<std::int32_t> index_("index");
+
+    using record =
+        aeternum::fields<std::string, std::int32_t>
+            ::record<tag, name_, index_>;
+}
+
+namespace std {
+    template<>
+    struct hash<row::record>
+    {
+        std::size_t operator()(const row::record& record) const noexcept
+        {
+            return record.get_hash();
+        }
+    };
+}
+
+static int failures = 0;
+
+static void expect(bool condition, const std::string& message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << std::endl;
+        failures++;
+    }
+}
+
+// Builds every row count up to a few more than the thread count, including counts that do not divide
+// evenly across threads and counts smaller than the thread count, and checks each row lands in order.
+static void every_split(std::size_t threads) {
+    for (std::size_t rows = 0; rows <= threads * 2 + 1; rows++) {
+        std::vector<std::string> names;
+        std::vector<std::int32_t> indices;
+        for (std::size_t i = 0; i < rows; i++) {
+            names.push_back("row " + std::to_string(i));
+            indices.push_back(static_cast<std::int32_t>(i));
+        }
+
+        auto const context = std::to_string(rows) + " rows on " + std::to_string(threads) + " threads";
+        try {
+            auto const records = row::record::make_many(threads, names, indices);
+            expect(records.size() == rows, context + " built " + std::to_string(records.size()) + " records");
+            for (std::size_t i = 0; i < records.size(); i++) {
+                expect(records[i][row::name_] == names[i] && records[i][row::index_] == indices[i],
+                       context + " built the wrong record at " + std::to_string(i));
+            }
+        } catch (const std::exception& e) {
+            expect(false, context + " threw " + e.what());
+        }
+    }
+}
+
+int main() {
+    for (std::size_t threads = 1; threads <= 9; threads++) {
+        every_split(threads);
+    }
+
+    if (failures > 0) {
+        std::cerr << failures << " make_many checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "All make_many checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
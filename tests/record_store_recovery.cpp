@@ -0,0 +1,236 @@
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "atom.h"
+#include "record.h"
+#include "record_store.h"
+
+namespace item {
+    constexpr aeternum::atom tag("item");
+
+    constexpr aeternum::field_name<std::string> name_("name");
+    constexpr aeternum::field_name<std::int32_t> count_("count");
+
+    using record =
+        aeternum::fields<std::string, std::int32_t>
+            ::record<tag, name_, count_>;
+}
+
+namespace std {
+    template<>
+    struct hash<item::record>
+    {
+        std::size_t operator()(const item::record& record) const noexcept
+        {
+            return record.get_hash();
+        }
+    };
+}
+
+using store = aeternum::record_store<std::string, item::record>;
+using state = std::map<std::string, std::int32_t>;
+
+namespace fs = std::filesystem;
+
+static int failures = 0;
+
+static void expect(bool condition, const std::string& message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << std::endl;
+        failures++;
+    }
+}
+
+static state read_state(const fs::path& directory) {
+    store items(directory);
+    state result;
+    for (auto& kvp : items.snapshot()) {
+        result[kvp.first] = kvp.second[item::count_];
+    }
+    return result;
+}
+
+static std::string describe(const state& items) {
+    std::string result = "{";
+    for (auto& kvp : items) {
+        result += " " + kvp.first + "=" + std::to_string(kvp.second);
+    }
+    return result + " }";
+}
+
+static void put(store& items, state& expected, const std::string& key, std::int32_t count) {
+    items.put(key, item::record::make(std::string(key), std::int32_t(count)));
+    expected[key] = count;
+}
+
+static void erase(store& items, state& expected, const std::string& key) {
+    items.erase(key);
+    expected.erase(key);
+}
+
+// Cuts the log at every offset of the entries written after a checkpoint, and checks that each cut
+// recovers the state after the last whole entry and still accepts writes.
+static void every_truncation(const fs::path& root) {
+    auto const original = root / "original";
+
+    std::vector<std::uintmax_t> boundaries;
+    std::vector<state> states;
+    {
+        store items(original);
+        state expected;
+        put(items, expected, "apples", 1);
+        put(items, expected, "pears", 2);
+        items.checkpoint();
+
+        boundaries.push_back(fs::file_size(original / "log"));
+        states.push_back(expected);
+
+        put(items, expected, "apples", 3);
+        items.commit();
+        boundaries.push_back(fs::file_size(original / "log"));
+        states.push_back(expected);
+
+        erase(items, expected, "pears");
+        items.commit();
+        boundaries.push_back(fs::file_size(original / "log"));
+        states.push_back(expected);
+
+        put(items, expected, "plums", 4);
+        items.commit();
+        boundaries.push_back(fs::file_size(original / "log"));
+        states.push_back(expected);
+    }
+
+    for (std::uintmax_t cut = 0; cut <= boundaries.back(); cut++) {
+        auto const directory = root / "cut";
+        fs::remove_all(directory);
+        fs::copy(original, directory);
+        fs::resize_file(directory / "log", cut);
+
+        auto expected = states.front();
+        for (std::size_t i = 0; i < boundaries.size(); i++) {
+            if (boundaries[i] <= cut) {
+                expected = states[i];
+            }
+        }
+
+        auto const recovered = read_state(directory);
+        expect(recovered == expected, "cut at " + std::to_string(cut) + " recovered " + describe(recovered)
+                                      + ", expected " + describe(expected));
+
+        {
+            store items(directory);
+            put(items, expected, "cherries", 5);
+            items.commit();
+        }
+        auto const rewritten = read_state(directory);
+        expect(rewritten == expected, "write after cut at " + std::to_string(cut) + " recovered "
+                                      + describe(rewritten) + ", expected " + describe(expected));
+    }
+}
+
+// Restores the log a checkpoint emptied, as if the process had died between writing the snapshot and
+// emptying the log. The snapshot also covers updates that were never committed to the log.
+static void interrupted_checkpoint(const fs::path& root) {
+    auto const directory = root / "interrupted";
+    auto const stale_log = root / "stale-log";
+
+    state expected;
+    {
+        store items(directory);
+        put(items, expected, "apples", 1);
+        put(items, expected, "pears", 2);
+        items.commit();
+        fs::copy_file(directory / "log", stale_log);
+
+        put(items, expected, "apples", 3);
+        erase(items, expected, "pears");
+        items.checkpoint();
+    }
+    fs::copy_file(stale_log, directory / "log", fs::copy_options::overwrite_existing);
+
+    auto const recovered = read_state(directory);
+    expect(recovered == expected, "interrupted checkpoint recovered " + describe(recovered)
+                                  + ", expected " + describe(expected));
+
+    {
+        store items(directory);
+        put(items, expected, "plums", 4);
+        items.commit();
+    }
+    auto const rewritten = read_state(directory);
+    expect(rewritten == expected, "write after interrupted checkpoint recovered " + describe(rewritten)
+                                  + ", expected " + describe(expected));
+}
+
+static void limit_file_size(rlim_t bytes) {
+    rlimit limit{};
+    getrlimit(RLIMIT_FSIZE, &limit);
+    limit.rlim_cur = bytes;
+    setrlimit(RLIMIT_FSIZE, &limit);
+}
+
+// Fails a commit partway through its write by limiting the size of files the process may write, then
+// checks that the torn entry does not hide later commits and that the failed entries are written again.
+static void failed_commit(const fs::path& root) {
+    auto const directory = root / "failed";
+
+    rlimit original{};
+    getrlimit(RLIMIT_FSIZE, &original);
+    std::signal(SIGXFSZ, SIG_IGN);
+
+    state expected;
+    {
+        store items(directory);
+        put(items, expected, "apples", 1);
+        items.commit();
+
+        auto const durable = fs::file_size(directory / "log");
+        put(items, expected, std::string(256, 'x'), 2);
+        limit_file_size(durable + 64);
+
+        bool threw = false;
+        try {
+            items.commit();
+        } catch (const std::system_error&) {
+            threw = true;
+        }
+        limit_file_size(original.rlim_cur);
+
+        expect(threw, "commit past the file size limit did not fail");
+        expect(fs::file_size(directory / "log") == durable, "failed commit left a torn entry in the log");
+
+        put(items, expected, "pears", 3);
+        items.commit();
+    }
+
+    auto const recovered = read_state(directory);
+    expect(recovered == expected, "failed commit recovered " + describe(recovered) + ", expected " + describe(expected));
+}
+
+int main() {
+    auto const root = fs::temp_directory_path() / "aeternum-record-store-recovery";
+    fs::remove_all(root);
+    fs::create_directories(root);
+
+    every_truncation(root);
+    interrupted_checkpoint(root);
+    failed_commit(root);
+
+    fs::remove_all(root);
+
+    if (failures > 0) {
+        std::cerr << failures << " record store recovery checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "All record store recovery checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}